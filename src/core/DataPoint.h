@@ -3,19 +3,100 @@
 #define _C2MATICA_DATAPOINT_H_
 
 #include <tuple>
+#include <vector>
+#include <atomic>
+#include <memory>
 #include <shared_mutex>
 #include <tesseract/baseapi.h>
 
 #include "core/Stoppable.h"
 #include "core/Timer.h"
 #include "core/Ocr.h"
+#include "core/Rule.h"
+#include "core/Overload.h"
+#include "core/Voting.h"
+#include "core/WorkerPool.h"
 
 namespace c2matica {
 
-class DataPoint : public Stoppable
+class DataPoint
+    : public Stoppable
+    , public std::enable_shared_from_this<DataPoint>
 {
 public:
     static const uint32_t DEFAULT_POOLING_INTERVAL;
+    static const uint32_t DEFAULT_ADAPTIVE_MAX_INTERVAL;
+    static const double DEFAULT_ADAPTIVE_BACKOFF_FACTOR;
+    static const double DEFAULT_ADAPTIVE_STABLE_DISTANCE;
+    static const uint32_t DEFAULT_EVENT_HEARTBEAT;
+    static const double MIN_SCALE;
+    static const double MAX_SCALE;
+    static const uint32_t POLARITY_RECHECK_INTERVAL;
+
+    // Stretch the effective polling interval while both the recognized
+    // value and the ROI fingerprint are stable, snap back to pollingInterval
+    // when either changes.
+    struct AdaptivePolling
+    {
+        bool enabled;
+        uint32_t maxInterval;   // ms, upper bound of effective interval
+        double backoffFactor;   // effective interval *= factor when stable
+        double stableDistance;  // fingerprint distance regarded as stable
+    };
+
+    // A read whose mean confidence is below minConfidence is recognized
+    // once more from an Otsu binarized image, optionally with another page
+    // segmentation mode, and the more confident read is kept.
+    struct RetryPolicy
+    {
+        uint32_t minConfidence; // 0..100, 0 never retry
+        int alternatePsm;       // tesseract::PageSegMode, -1 keep
+    };
+
+    // Defer the read of a region that changed within settleTime, e.g. a
+    // display being redrawn, but never for longer than maxDeferral.
+    struct SettlePolicy
+    {
+        uint32_t settleTime;    // ms, 0 never defer
+        uint32_t maxDeferral;   // ms
+    };
+
+    // A polling datapoint is read every polling interval. An event one is
+    // read when the capture sees its region change, at most once per
+    // polling interval, and at least once per heartbeat.
+    enum class TriggerMode
+    {
+        POLLING,
+        EVENT,
+    };
+
+    // A table of rows x cols equal cells from the coordinate origin, read
+    // with one image set on the engine and a rectangle per cell. A value
+    // is emitted per cell. rows or cols 0 is a single value datapoint.
+    struct Grid
+    {
+        uint32_t rows;
+        uint32_t cols;
+        uint32_t cellWidth;
+        uint32_t cellHeight;
+
+        bool enabled() const { return rows > 0 && cols > 0; }
+        bool operator==(Grid const& other) const
+        {
+            return rows == other.rows && cols == other.cols &&
+                cellWidth == other.cellWidth && cellHeight == other.cellHeight;
+        }
+        bool operator!=(Grid const& other) const { return !(*this == other); }
+    };
+
+    // coordinate checked against the stream resolution
+    enum class RoiState
+    {
+        UNKNOWN,    // resolution not known yet
+        VALID,
+        CLAMPED,    // partly outside, cut to the frame
+        INVALID,    // outside the frame, not recognized
+    };
 
 public:
     DataPoint() = delete;
@@ -33,48 +114,313 @@ public:
     {
         std::unique_lock<std::shared_mutex> l(_mutex);
         _coordinate = std::make_tuple(x, y, width, height);
+        validateRoi();
     }
     void setCoordinate(
         std::tuple<uint32_t, uint32_t, uint32_t, uint32_t> const& coordinate)
     {
         std::unique_lock<std::shared_mutex> l(_mutex);
         _coordinate = coordinate;
+        validateRoi();
+    }
+    // stream resolution, the coordinate is validated against it
+    void setFrameSize(cv::Size const& size)
+    {
+        std::unique_lock<std::shared_mutex> l(_mutex);
+        _frameSize = size;
+        validateRoi();
+    }
+    // drift of the camera view, the coordinate is shifted by it
+    void setOffset(cv::Point const& offset)
+    {
+        std::unique_lock<std::shared_mutex> l(_mutex);
+        _offset = offset;
+        validateRoi();
+    }
+    // region actually read, empty for the whole frame
+    cv::Rect getRoi(RoiState* state = NULL)
+    {
+        std::shared_lock<std::shared_mutex> l(_mutex);
+        if (state)
+            *state = _roiState;
+        return _roi;
     }
     void setPollingInterval(uint32_t poolingInterval);
+    void setRule(std::shared_ptr<const Rule> rule)
+    {
+        std::unique_lock<std::shared_mutex> l(_mutex);
+        _rule = rule;
+    }
+    std::shared_ptr<const Rule> getRule()
+    {
+        std::shared_lock<std::shared_mutex> l(_mutex);
+        return _rule;
+    }
+    // the rule did not compile, the raw text is published with the error
+    void setRuleError(std::string const& error)
+    {
+        std::unique_lock<std::shared_mutex> l(_mutex);
+        _ruleError = error;
+    }
+    std::string getRuleError()
+    {
+        std::shared_lock<std::shared_mutex> l(_mutex);
+        return _ruleError;
+    }
+    // when the region is read next, for the gather of the capture thread
+    std::shared_ptr<const RoiGather::Due> getReadDue() const
+    {
+        return _readDue;
+    }
+    // publish rawValue next to the value of a rule
+    void setKeepOriginalValue(bool keep) { _keepOriginalValue = keep; }
+    bool getKeepOriginalValue() const { return _keepOriginalValue; }
     auto getCoordinate()
         -> std::tuple<uint32_t, uint32_t, uint32_t, uint32_t>&
     {
         std::shared_lock<std::shared_mutex> l(_mutex);
         return _coordinate;
     }
-    uint32_t getPollingInterval()
+    uint32_t getPollingInterval() const { return _pollingInterval.load(); }
+    // polling interval currently in use, differs when adaptive
+    uint32_t getEffectiveInterval()
     {
         std::shared_lock<std::shared_mutex> l(_mutex);
-        return _pollingInterval;
+        return _effectiveInterval;
     }
+    void setAdaptivePolling(AdaptivePolling const& adaptive);
+    void setTriggerMode(TriggerMode mode)
+    {
+        std::unique_lock<std::shared_mutex> l(_mutex);
+        _triggerMode = mode;
+    }
+    TriggerMode getTriggerMode()
+    {
+        std::shared_lock<std::shared_mutex> l(_mutex);
+        return _triggerMode;
+    }
+    // the coordinate must span the grid
+    void setGrid(Grid const& grid)
+    {
+        std::unique_lock<std::shared_mutex> l(_mutex);
+        _grid = grid;
+    }
+    Grid getGrid()
+    {
+        std::shared_lock<std::shared_mutex> l(_mutex);
+        return _grid;
+    }
+    // Rescale the region so that its text is about xHeight px high, the
+    // height Tesseract reads best. The factor is estimated from the
+    // projection profile of the first read and kept until the region
+    // size changes. 0 never rescales.
+    void setTargetXHeight(uint32_t xHeight)
+    {
+        std::unique_lock<std::shared_mutex> l(_mutex);
+        _targetXHeight = xHeight;
+    }
+    // Detect light text on a dark background and invert it before the
+    // engine sees it, so that the engine never retries a read inverted.
+    // Takes effect when the engine is initialized on start.
+    void setPolarityDetection(bool enabled)
+    {
+        std::unique_lock<std::shared_mutex> l(_mutex);
+        _polarityDetection = enabled;
+    }
+    // ms an event datapoint is read without any change, 0 never
+    void setEventHeartbeat(uint32_t heartbeat)
+    {
+        _eventHeartbeat = heartbeat;
+    }
+    void setRetryPolicy(RetryPolicy const& retry)
+    {
+        std::unique_lock<std::shared_mutex> l(_mutex);
+        _retry = retry;
+    }
+    void setSettlePolicy(SettlePolicy const& settle)
+    {
+        std::unique_lock<std::shared_mutex> l(_mutex);
+        _settle = settle;
+    }
+    void setVotingPolicy(Voting::Policy const& policy)
+    {
+        std::lock_guard<std::recursive_mutex> l(_rMutex);
+        _voting.setPolicy(policy);
+        // the last vote was taken under the old policy
+        _lastReadFingerprint.release();
+    }
+    void setOverloadPolicy(Overload::Policy const& policy)
+    {
+        _overload.setPolicy(policy);
+    }
+    // recognize on the pool instead of the timer thread, NULL inline
+    void setWorkerPool(WorkerPool* pool) { _pool = pool; }
 
     bool start() override;
     void stop() override;
 
+    // The region of an event datapoint changed, changes is its change
+    // count. Called by the capture thread, takes no datapoint lock, the
+    // read is queued on the worker pool.
+    void trigger(uint64_t changes);
+
+    static char const* toString(TriggerMode mode);
+    // false if name is neither polling nor event
+    static bool parseTriggerMode(std::string const& name, TriggerMode& mode);
+
 private:
     const std::string _id;
     const std::string _dataPath; // tessdata path
     const std::string _language; // language in tessdata
+    // metric names, built once instead of per read
+    const std::string _outvotedMetric;
+    const std::string _scaleMetric;
+    const std::string _invertedMetric;
+    const std::string _deferredMetric;
+    const std::string _retriesMetric;
+    const std::string _roiErrorMetric;
 
     // x, y, width, height
     std::tuple<uint32_t, uint32_t, uint32_t, uint32_t> _coordinate;
-    uint32_t _pollingInterval;
+    cv::Size _frameSize;
+    cv::Point _offset;
+    // cut from the left and top of a clamped region, 0 otherwise
+    cv::Point _roiClip;
+    cv::Rect _roi;
+    RoiState _roiState;
+    // atomic, read by the capture thread through trigger()
+    std::atomic<uint32_t> _pollingInterval;
+    // stretched by adaptive polling
+    uint32_t _adaptiveInterval;
+    // _adaptiveInterval multiplied while demoted
+    uint32_t _effectiveInterval;
+    AdaptivePolling _adaptive;
+    RetryPolicy _retry;
+    SettlePolicy _settle;
+    TriggerMode _triggerMode;
+    std::atomic<uint32_t> _eventHeartbeat;
+    Grid _grid;
+    uint32_t _targetXHeight;
+    bool _polarityDetection;
+    std::string _lastValue;
+    cv::Mat _lastFingerprint;
+    std::shared_ptr<const Rule> _rule;
+    std::string _ruleError;
+    std::atomic<bool> _keepOriginalValue;
     std::shared_mutex _mutex;
 
     Ocr* _ocr;
+    Overload _overload;
+    WorkerPool* _pool;
+    // a job of this datapoint is queued or running
+    std::atomic<bool> _busy{ false };
+    // last read dispatched in event mode, and the change count of the
+    // region it read
+    std::atomic<Timer::steady_time> _eventDispatchedAt{ Timer::steady_time() };
+    std::atomic<uint64_t> _eventReadChanges{ 0 };
+    // last timer tick, and when the region is read next: a tick after the
+    // last read, 0 while a read is dispatched
+    std::atomic<Timer::steady_time> _lastTick{ Timer::steady_time() };
+    std::shared_ptr<RoiGather::Due> _readDue;
     std::recursive_mutex _rMutex;
     tesseract::TessBaseAPI* _api;
+    // copy of the frame reused across polls, guarded by _rMutex
+    cv::Mat _frameBuffer;
+    // binarized image of a retry, guarded by _rMutex
+    cv::Mat _retryBuffer;
+    // binarized image of a grid, guarded by _rMutex
+    cv::Mat _gridBuffer;
+    // scale of the region, estimated for _scaleGeometry, guarded by
+    // _rMutex
+    cv::Size _scaleGeometry;
+    double _scale;
+    cv::Mat _scaleBuffer;
+    // polarity of the region, checked for _polarityGeometry at
+    // _polarityCheckedAt, guarded by _rMutex
+    bool _inverted;
+    cv::Size _polarityGeometry;
+    Timer::steady_time _polarityCheckedAt;
+    cv::Mat _polarityBuffer;
+
+    // one recognition of the region
+    struct Reading
+    {
+        struct Word
+        {
+            std::string text;
+            float confidence;
+            cv::Rect box;
+        };
+
+        std::string text;
+        int confidence;     // mean, 0..100
+        std::vector<Word> words;
+    };
+
+    // guarded by _rMutex
+    Voting _voting;
+    // first deferred read while the region settles, guarded by _rMutex
+    Timer::steady_time _deferredSince;
+    // reused while the region does not change, up to MAX_READING_REUSE
+    // times in a row, guarded by _rMutex
+    Reading _lastReading;
+    cv::Mat _lastReadFingerprint;
+    uint32_t _readingReuse;
+    // outcome of the vote on _lastReading
+    struct Vote
+    {
+        bool agreed;
+        std::string value;
+        double support;
+    };
+    Vote _lastVote;
+    // fingerprint of the read, swapped with _lastFingerprint by adapt so
+    // that both buffers are reused, guarded by _rMutex
+    cv::Mat _thumbnail;
     Timer _timer;
 
     bool initTessApi();
     void releaseTessApi();
 
     void run(Timer::system_time const &tp);
+    // recognize on the pool, or inline without one
+    void dispatch(Timer::system_time const &tp, Timer::steady_time scheduled);
+    // an event datapoint has something to read, spacing applies to
+    // triggers, timer ticks are spaced already. A trigger brings the change
+    // count of its region, a tick looks it up.
+    bool eventDue(Timer::steady_time now, bool triggered, uint64_t changes = 0);
+    void process(Timer::system_time const &tp, Timer::steady_time scheduled);
+    void recognize(Timer::system_time const &tp);
+    void recognizeGrid(cv::Mat const& frame,
+        Grid const& grid,
+        cv::Point const& clip,
+        double scale,
+        cv::Mat& thumbnail,
+        Timer::system_time const& tp,
+        Ocr::FrameInfo const& frameInfo,
+        Timer::system_time const& recognizeStart);
+    // _rMutex must be held
+    void read(cv::Mat const& image, Reading& reading);
+    void readWithRetry(cv::Mat const& image, Reading& reading);
+    // cells in row major order, empty text for cells outside the image.
+    // clip is what the region lost at the left and top frame edges, the
+    // grid starts that far before the image.
+    void readGrid(cv::Mat const& image,
+        Grid const& grid,
+        cv::Point const& clip,
+        double scale,
+        std::vector<Reading>& cells);
+    // image rescaled to the target x-height, factor is 1 if unchanged
+    cv::Mat const& rescale(cv::Mat const& image, double& factor);
+    // image as dark text on a light background
+    cv::Mat const& normalizePolarity(cv::Mat const& image);
+    // false to defer the read, the region is still changing
+    bool settled(uint32_t stableMs);
+    void adapt(std::string const& value, cv::Mat& fingerprint);
+    // _mutex must be held, return true if effective interval changed
+    bool updateEffectiveInterval();
+    // _mutex must be held
+    void validateRoi();
 };
 
 std::shared_ptr<DataPoint> makeDataPoint(
@@ -0,0 +1,75 @@
+#ifndef _C2MATICA_DRIFTTRACKER_H_
+#define _C2MATICA_DRIFTTRACKER_H_
+
+#include <memory>
+#include <vector>
+#include <opencv2/core.hpp>
+
+#include "core/Timer.h"
+
+namespace c2matica {
+
+// Follow a camera that has been bumped.
+//
+// Anchors are small regions of static, textured content, e.g. a label or
+// the bezel of a screen. Their templates are taken from the first frame
+// seen after start, or after the resolution changed. Every checkInterval
+// each anchor is searched by normalized template matching within
+// searchRadius of where it was found last, and the median displacement of
+// the anchors matching at least minScore is the offset of the view. Only
+// the search windows are converted and matched, a check costs a few ms.
+class DriftTracker
+{
+public:
+    static const uint32_t DEFAULT_CHECK_INTERVAL;
+    static const int32_t DEFAULT_SEARCH_RADIUS;
+    static const double DEFAULT_MIN_SCORE;
+
+    struct Policy
+    {
+        std::vector<cv::Rect> anchors;  // empty never tracked
+        uint32_t checkInterval;         // ms, 0 never tracked
+        int32_t searchRadius;           // px, per check
+        double minScore;                // normalized correlation, 0..1
+    };
+
+public:
+    DriftTracker();
+
+    // must be called before the capture starts
+    void setPolicy(Policy const& policy);
+    bool enabled() const
+    {
+        return !_policy.anchors.empty() && _policy.checkInterval > 0;
+    }
+
+    // the anchors should be located in the next frame
+    bool due(Timer::steady_time now) const;
+    // locate the anchors in frame, return true if the offset changed
+    bool update(cv::Mat const& frame, Timer::steady_time now);
+    // displacement of the view since the templates were taken
+    cv::Point getOffset() const { return _offset; }
+
+private:
+    struct Anchor
+    {
+        cv::Rect rect;
+        cv::Mat templ;  // gray
+    };
+
+    Policy _policy;
+    std::vector<Anchor> _anchors;
+    cv::Size _frameSize;
+    cv::Point _offset;
+    Timer::steady_time _lastCheck;
+    // reused across checks
+    cv::Mat _window;
+    cv::Mat _result;
+
+    void capture(cv::Mat const& frame);
+    static void toGray(cv::Mat const& image, cv::Mat& gray);
+};
+
+}
+
+#endif
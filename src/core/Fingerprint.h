@@ -0,0 +1,23 @@
+#ifndef _C2MATICA_FINGERPRINT_H_
+#define _C2MATICA_FINGERPRINT_H_
+
+#include <opencv2/core.hpp>
+
+namespace c2matica {
+
+// Size of the gray thumbnail used as ROI fingerprint
+static const int FINGERPRINT_SIZE = 16;
+
+// Downscale image to a FINGERPRINT_SIZE square gray thumbnail, area
+// interpolation averages the sensor noise away. Nothing is allocated once
+// thumbnail has that size.
+void fingerprint(cv::Mat const& image, cv::Mat& thumbnail);
+
+// Largest absolute difference of two thumbnails over their cells in
+// [0, 255], the maximum if either is empty. A changed digit shows in the
+// few cells it covers, a mean over all of them would dilute it.
+double fingerprintDistance(cv::Mat const& a, cv::Mat const& b);
+
+}
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef _C2MATICA_FRAMEPOOL_H_
+#define _C2MATICA_FRAMEPOOL_H_
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <opencv2/core.hpp>
+
+namespace c2matica {
+
+// Fixed set of frame buffers carved out of one mapping, optionally backed
+// by huge pages. Buffers are recycled through a lock-free free list, so
+// that frames are not allocated at frame rate once the pool is sized for
+// the stream geometry.
+//
+// framePool.heapFrames counts frames retrieved onto the heap and
+// framePool.reallocations every (re)sizing. They count pool misses only,
+// not every allocation of the capture loop.
+class FramePool
+{
+public:
+    static const std::size_t DEFAULT_COUNT;
+
+    struct Buffer
+    {
+        cv::Mat mat;        // header over the pool memory
+        uchar* data;        // pool memory of this buffer
+        uint32_t index;
+    };
+
+public:
+    FramePool(std::size_t count = DEFAULT_COUNT);
+    ~FramePool();
+
+    FramePool(FramePool const&) = delete;
+    FramePool& operator=(FramePool const&) = delete;
+
+    // takes effect on the next reset
+    void setHugePages(bool hugePages) { _hugePages = hugePages; }
+
+    // (re)map buffers for frames of size and type, every buffer must have
+    // been released
+    bool reset(cv::Size size, int type);
+    bool fits(cv::Size size, int type) const;
+
+    // NULL if all buffers are in use or the pool is not sized yet
+    Buffer* acquire();
+    // safe from any thread
+    void release(Buffer* buffer);
+
+    // false if the buffer was written with another geometry and OpenCV
+    // moved its header onto a heap allocation
+    static bool owns(Buffer const* buffer)
+    {
+        return buffer->mat.data == buffer->data;
+    }
+
+private:
+    std::vector<Buffer> _buffers;
+    std::unique_ptr<std::atomic<uint32_t>[]> _next;
+    // free list head, index + 1 in the low half, ABA tag in the high half
+    std::atomic<uint64_t> _head;
+    std::atomic<int> _outstanding;
+
+    cv::Size _size;
+    int _type;
+    bool _hugePages;
+    void* _memory;
+    std::size_t _mapped;
+
+    void unmap();
+};
+
+}
+
+#endif
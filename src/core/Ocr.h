@@ -6,11 +6,18 @@
 #include <atomic>
 #include <thread>
 #include <mutex>
+#include <vector>
 #include <unordered_map>
+#include <future>
+#include <optional>
 #include <condition_variable>
 #include <opencv2/videoio.hpp>
 
+#include "core/DriftTracker.h"
+#include "core/FramePool.h"
+#include "core/RoiGather.h"
 #include "core/Stoppable.h"
+#include "core/StreamHealth.h"
 #include "core/Timer.h"
 
 namespace c2matica {
@@ -21,8 +28,43 @@ class Ocr : public Stoppable
 {
 public:
     static int32_t const DEFAULT_RECONNECT_INTERVAL;
+    static int32_t const DEFAULT_RECONNECT_MAX_INTERVAL;
+    static int32_t const DEFAULT_OPEN_TIMEOUT;
+    static double const DEFAULT_RECONNECT_JITTER;
     static int32_t const DEFAULT_UPDATEINFPS_INTERVAL;
 
+    // Reconnect delay starts at reconnectInterval, doubles on each failed
+    // attempt up to maxInterval, and is spread by +-jitter. An open taking
+    // longer than openTimeout is abandoned and counts as failed.
+    struct ReconnectPolicy
+    {
+        int32_t maxInterval;    // ms
+        int32_t openTimeout;    // ms
+        double jitter;          // fraction of the delay
+    };
+
+    // Tuning of the FFmpeg capture backend, zero or empty keeps the
+    // backend default.
+    struct CaptureOptions
+    {
+        std::string rtspTransport;  // tcp or udp
+        uint32_t probesize;         // bytes
+        uint32_t analyzeDuration;   // ms
+        bool noBuffer;              // fflags nobuffer, no input buffering
+        bool lowDelay;              // flags low_delay, no frame reordering
+        uint32_t decodeThreads;
+        uint32_t socketTimeout;     // ms
+        bool hugePages;             // frame buffers on huge pages
+        bool roiGray;               // gather datapoint regions as gray
+    };
+
+    // when the pixels of a frame were captured
+    struct FrameInfo
+    {
+        double pts;                 // ms, stream position, -1 unknown
+        Timer::system_time arrival; // grab returned
+    };
+
 public:
     Ocr() = delete;
     Ocr(Stoppable* parent,
@@ -34,6 +76,11 @@ public:
     bool addDataPoint(std::shared_ptr<DataPoint> dataPoint);
     bool delDataPoint(std::string const& id);
     void modDataPoint(std::shared_ptr<DataPoint> newDP);
+    // apply a reload diff under one lock, out fps is recalculated once
+    void applyDataPoints(
+        std::vector<std::shared_ptr<DataPoint>> const& addDPs,
+        std::vector<std::shared_ptr<DataPoint>> const& modDPs,
+        std::vector<std::string> const& delIDs);
     std::shared_ptr<DataPoint> getDataPoint(std::string const& id);
 
     // Start grab and recoginize
@@ -42,24 +89,96 @@ public:
     // Stop grab and release resource
     void stop() override;
 
-    bool getFrame(cv::Mat& frame);
+    bool getFrame(cv::Mat& frame, FrameInfo* info = NULL);
+    // view of the region of datapoint id gathered from the current frame,
+    // valid while arena is held, false if the region is not gathered
+    bool getRoi(std::string const& id,
+        cv::Rect const& rect,
+        std::shared_ptr<const RoiGather::Arena>& arena,
+        cv::Mat& view,
+        FrameInfo* info = NULL,
+        RoiGather::RegionState* state = NULL);
+    // change tracking of the region of datapoint id in the current frame,
+    // false if the region is not gathered
+    bool getRoiState(std::string const& id,
+        cv::Rect const& rect,
+        RoiGather::RegionState& state);
+    // track how long every region has been unchanged
+    void setSettling(bool settling) { _roiGather.setSettling(settling); }
+    // fingerprint distance of a region regarded as changed
+    void setChangeDistance(double distance)
+    {
+        _roiGather.setChangeDistance(distance);
+    }
+    bool isOpened() const { return _opened.load(); }
+
+    void setReconnectPolicy(ReconnectPolicy const& policy);
+    // must be called before start
+    void setCaptureOptions(CaptureOptions const& options);
+    void setHealthPolicy(StreamHealth::Policy const& policy);
+    // must be called before start
+    void setDriftPolicy(DriftTracker::Policy const& policy);
+    // homography from the frame to a rectified view the datapoint
+    // coordinates refer to, must be called before start
+    void setPerspective(cv::Matx33d const& homography);
+    // regions are read from the rectified view, never cut from the frame
+    bool isRectified() const { return _perspective.has_value(); }
+    StreamHealth::State getHealth() const { return _health.getState(); }
+
+    // A datapoint changed its effective polling interval, out fps is
+    // recalculated on the next updateInFPS tick. Never takes _mutexDP,
+    // so it is safe from datapoint timer threads.
+    void requestCalcOutFPS() { _outFPSDirty.store(true); }
 
 private:
     const std::string _streamURL;
     const std::string _saveImageDirPath;
 
+    // swapped by the connect timer, grabbed by the run timer
+    std::mutex _mutexCap;
     std::shared_ptr<cv::VideoCapture> _cap;
     
     std::recursive_mutex _mutexDP;
     std::unordered_map<std::string, std::shared_ptr<DataPoint>> _dpMap;
+    // stream resolution the datapoint regions are validated against
+    cv::Size _frameSize;
+    // drift of the camera view, applied to the datapoint regions, a
+    // rectified view takes it in the remap table and keeps this at 0
+    cv::Point _roiOffset;
     double _inFPS;
     double _outFPS;
     std::atomic<int> _frameInterval;
+    std::atomic<bool> _outFPSDirty{ false };
 
+    FramePool _framePool;
     std::shared_mutex _mutexFrame;
-    cv::Mat _frame;
+    FramePool::Buffer* _frame;
+    FrameInfo _frameInfo;
+    RoiGather _roiGather;
+    std::shared_ptr<const RoiGather::Arena> _roiArena;
+    // event triggered datapoints by id, snapshot for the capture thread
+    // which must not take _mutexDP
+    std::mutex _mutexEvent;
+    std::unordered_map<std::string, std::weak_ptr<DataPoint>> _eventDPs;
+
+    StreamHealth _health;
+    // owned by the capture thread
+    DriftTracker _drift;
 
     int32_t _reconnectInterval;
+    ReconnectPolicy _reconnectPolicy;
+    int _reconnectAttempts;
+    std::atomic<Timer::steady_time> _disconnectedAt;
+    // open running on its own thread, kept when it timed out so that a
+    // late success is still used and attempts never pile up
+    struct PendingOpen
+    {
+        std::shared_ptr<cv::VideoCapture> cap;
+        std::shared_future<bool> result;
+    };
+    std::optional<PendingOpen> _pendingOpen;
+    CaptureOptions _captureOptions;
+    std::optional<cv::Matx33d> _perspective;
 
     std::mutex _mutex;
     std::atomic<bool> _opened{ false };
@@ -70,15 +189,38 @@ private:
     Timer _updateInFPSTimer;
 
 private:
-    bool waitConnected();
+    std::shared_ptr<cv::VideoCapture> getCap();
+    void onConnected(std::shared_ptr<cv::VideoCapture> cap);
+    void onDisconnected();
+    void scheduleReconnect();
+
+    // _mutexDP must be held, return true if out fps needs recalculating
+    bool insertDataPoint(std::shared_ptr<DataPoint> dataPoint);
+    bool eraseDataPoint(std::string const& id);
+    bool updateDataPoint(std::shared_ptr<DataPoint> newDP);
+    // _mutexDP must be held
+    void updateRegions();
+    void setFrameSize(cv::Size const& size);
+    void setRoiOffset(cv::Point const& offset);
+
     void connect(Timer::system_time const& tp);
     void run();
-    void putFrame(cv::Mat const& Frame);
+    FramePool::Buffer* retrieveFrame(cv::VideoCapture& cap);
+    // takes the buffer, the replaced one returns to the pool
+    void putFrame(FramePool::Buffer* buffer,
+        FrameInfo const& info = {},
+        std::shared_ptr<const RoiGather::Arena> arena = NULL);
+    // trigger the datapoints of event regions changed in arena
+    void triggerEvents(RoiGather::Arena const& arena);
+    // regions read before this are gathered from a frame of now
+    Timer::steady_time gatherHorizon(Timer::steady_time now);
     void calcOutFPS();
     void updateInFPS(Timer::system_time const &tp);
     void setFrameInterval();
     inline int getFrameInterval();
 
+    // the image is taken on the first connect only, not on reconnects
+    std::once_flag _imageOnce;
     bool takeAImage();
 };
 
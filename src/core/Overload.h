@@ -0,0 +1,75 @@
+#ifndef _C2MATICA_OVERLOAD_H_
+#define _C2MATICA_OVERLOAD_H_
+
+#include <atomic>
+#include <mutex>
+#include <string>
+
+#include "core/Timer.h"
+
+namespace c2matica {
+
+// Deadline aware load shedding of one datapoint.
+//
+// A job is scheduled every interval and should finish before the next one
+// is due. Jobs starting more than one interval late are dropped instead of
+// processed late. After demotionTimeout consecutive deadline misses the
+// datapoint is demoted, its interval multiplied by demotionFactor for
+// demotionPeriod seconds, then promoted again.
+class Overload
+{
+public:
+    static const uint32_t DEFAULT_DEMOTION_TIMEOUT;
+    static const uint32_t DEFAULT_DEMOTION_PERIOD;
+    static const uint32_t DEFAULT_DEMOTION_FACTOR;
+
+    struct Policy
+    {
+        uint32_t demotionTimeout;   // consecutive misses, 0 never demote
+        uint32_t demotionPeriod;    // s
+        uint32_t demotionFactor;    // interval multiplier while demoted
+    };
+
+public:
+    Overload() = delete;
+    Overload(std::string const& id);
+    ~Overload();
+
+    void setPolicy(Policy const& policy);
+
+    // false if the job is stale and must be dropped
+    bool admit(Timer::steady_time scheduled, uint32_t interval);
+    // the previous job is still queued or running
+    void dropBusy();
+    // return true if demotion state changed
+    bool complete(Timer::steady_time scheduled, uint32_t interval);
+    // promote when demotionPeriod elapsed, return true if state changed
+    bool checkPromote();
+
+    bool isDemoted() const { return _demoted.load(); }
+    // interval multiplier, demotionFactor while demoted
+    uint32_t multiplier() const { return _multiplier.load(); }
+
+private:
+    const std::string _id;
+    // metric names, built once instead of per job
+    const std::string _lagMetric;
+    const std::string _droppedMetric;
+    const std::string _deadlineMissesMetric;
+    const std::string _demotedMetric;
+    std::mutex _mutex;
+    Policy _policy;
+    uint32_t _misses;
+    std::atomic<bool> _demoted{ false };
+    std::atomic<uint32_t> _multiplier{ 1 };
+    Timer::steady_time _demotedUntil;
+
+    // number of demoted datapoints in process
+    static std::atomic<int> _demotedCount;
+
+    void setDemoted(bool demoted);
+};
+
+}
+
+#endif
@@ -0,0 +1,154 @@
+#ifndef _C2MATICA_ROIGATHER_H_
+#define _C2MATICA_ROIGATHER_H_
+
+#include <chrono>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <opencv2/core.hpp>
+
+namespace c2matica {
+
+// Extract the regions of all datapoints from a frame in one sweep.
+//
+// Regions are visited sorted by row, so the frame is walked top down once
+// instead of once per datapoint in timer order, and copied, optionally
+// converted to gray, into one packed arena. Datapoints read a view into
+// the arena rather than copying the full frame. Arenas are recycled once
+// no datapoint holds them any more.
+//
+// With a perspective set, the coordinates of the regions are in the
+// rectified view. The homography is compiled once per frame size into a
+// fixed point remap table, and only the pixels of the regions are
+// remapped, never the whole frame. A drift of the camera view, measured
+// in frame pixels, is folded into the table as a translation after the
+// homography, the regions themselves stay put.
+//
+// With settling on, or for regions of event triggered datapoints, the
+// fingerprint of a region is compared with the one taken at its last
+// change, so that a partial redraw over several frames is seen. How long
+// the region has not changed is recorded, so that a display being redrawn
+// is not read, and changed event regions are listed for the capture
+// thread to trigger their datapoints.
+//
+// A region whose owner reads it next only after the horizon of a gather
+// is skipped, its view left empty. Owners publish that time through Due,
+// a region read before then falls back to the full frame.
+class RoiGather
+{
+public:
+    static const double DEFAULT_CHANGE_DISTANCE;
+
+    // steady clock ms when the owner reads its region next, 0 now
+    typedef std::atomic<int64_t> Due;
+    static int64_t dueOf(std::chrono::steady_clock::time_point tp)
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            tp.time_since_epoch()).count();
+    }
+
+    struct Region
+    {
+        std::string id;
+        cv::Rect rect;
+        bool event;     // recognized on change, always tracked
+        std::shared_ptr<const Due> due;     // NULL always gathered
+    };
+
+    // regions in gather order with their lookup index
+    struct Layout
+    {
+        std::vector<Region> regions;
+        std::unordered_map<std::string, std::size_t> index;
+        bool events;    // any region is event triggered
+    };
+
+    // change tracking of one region, zero while not tracked
+    struct RegionState
+    {
+        uint32_t stableMs;  // ms the region has been unchanged
+        uint64_t changes;   // times the region changed, a sequence number
+    };
+
+    struct Arena
+    {
+        std::shared_ptr<const Layout> layout;
+        // views[i] holds layout->regions[i], empty if outside the frame
+        std::vector<cv::Mat> views;
+        // change tracking of views[i]
+        std::vector<RegionState> states;
+        // indices of event regions changed since the previous frame
+        std::vector<std::size_t> changed;
+        std::vector<uchar> memory;
+
+        // the view of region id at rect, NULL if not gathered
+        cv::Mat const* find(std::string const& id,
+            cv::Rect const& rect,
+            RegionState* state = NULL) const;
+    };
+
+public:
+    RoiGather();
+
+    // applied from the next gather
+    void setRegions(std::vector<Region> regions);
+    void setGray(bool gray) { _gray = gray; }
+    void setSettling(bool settling) { _settling = settling; }
+    // fingerprint distance of a region regarded as changed
+    void setChangeDistance(double distance) { _changeDistance = distance; }
+    // homography from the frame to the rectified view, must be called
+    // before the capture starts
+    void setPerspective(cv::Matx33d const& homography);
+    // displacement of the camera view in frame pixels, the remap table is
+    // compiled again on the next gather, called by the capture thread
+    void setFrameOffset(cv::Point const& offset);
+    bool empty();
+
+    // gather the regions of frame read up to horizon, NULL if there are
+    // none
+    std::shared_ptr<const Arena> gather(cv::Mat const& frame,
+        std::chrono::steady_clock::time_point horizon =
+            std::chrono::steady_clock::time_point::max());
+
+private:
+    std::mutex _mutex;
+    std::shared_ptr<const Layout> _layout;
+    bool _gray;
+    std::atomic<bool> _settling{ false };
+    std::atomic<double> _changeDistance;
+    bool _rectify;
+    // rectified view to frame
+    cv::Matx33d _inverse;
+
+    // owned by the capture thread
+    std::vector<std::shared_ptr<Arena>> _arenas;
+    // remap table of the rectified view, for frames of _mapSize
+    cv::Point _frameOffset;
+    cv::Size _mapSize;
+    cv::Mat _map1;
+    cv::Mat _map2;
+    cv::Mat _warped;
+    struct Motion
+    {
+        cv::Rect rect;
+        cv::Mat thumbnail;  // taken at the last change
+        std::chrono::steady_clock::time_point stableSince;
+        uint64_t changes = 0;
+    };
+    std::unordered_map<std::string, Motion> _motion;
+    std::shared_ptr<const Layout> _motionLayout;
+    cv::Mat _thumbnail;
+    // regions of the current gather
+    std::vector<char> _selected;
+
+    std::shared_ptr<Arena> recycle();
+    void compileMaps(cv::Size const& size);
+    void track(Arena& arena, std::chrono::steady_clock::time_point now);
+};
+
+}
+
+#endif
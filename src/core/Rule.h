@@ -0,0 +1,94 @@
+#ifndef _C2MATICA_RULE_H_
+#define _C2MATICA_RULE_H_
+
+#include <array>
+#include <regex>
+#include <string>
+#include <vector>
+#include <memory>
+#include <variant>
+
+namespace c2matica {
+
+// Post-processing rule applied to the recognized text of a datapoint.
+//
+// ruleContent is a list of steps separated by ';', each step is `name' or
+// `name:arg'. $1..$9 in the arg of a step are replaced by the comma
+// separated ruleArgs, $$ by $, except in regex patterns where $ is an
+// anchor. A separator ; , or = escaped by a backslash or quoted as ';'
+// is taken literally, a ; inside a regex character class never splits.
+// Supported steps:
+//
+//     trim                  strip leading and trailing white spaces
+//     regex:PATTERN         extract the first capture group (or whole match)
+//     map:O=0,l=1,' '=      single byte substitution, empty target deletes,
+//                           e.g. map:\,=.,'='=- maps , to . and = to -
+//     number[:scale[,off]]  parse as number, value = value * scale + off
+//     bool                  parse 1/0, true/false, on/off, yes/no
+//     clamp:min,max         clamp number into [min, max]
+//     unit:TEXT             tag the value with unit TEXT
+//
+// e.g. ruleContent `regex:([-0-9.]+);number:$1,$2;clamp:0,100'
+//      ruleArgs    `0.1,-5'
+class Rule
+{
+public:
+    typedef std::variant<std::monostate, double, bool, std::string> Value;
+
+    struct Result
+    {
+        bool ok;
+        Value value;
+        std::string unit;
+        std::string error;
+    };
+
+public:
+    Rule() = delete;
+    // throw std::invalid_argument or std::regex_error on malformed rule
+    Rule(std::string ident,
+        std::string content,
+        std::string args,
+        std::string unit);
+    ~Rule() = default;
+
+    std::string const& getIdent() const { return _ident; }
+
+    Result apply(std::string const& text) const;
+
+    static std::string cacheKey(
+        std::string const& ident,
+        std::string const& content,
+        std::string const& args,
+        std::string const& unit);
+
+private:
+    enum class Op { Trim, Regex, Map, Number, Bool, Clamp, Unit };
+
+    struct Step
+    {
+        Op op;
+        std::regex regex;
+        // map: byte -> replacement, -1 delete, -2 keep
+        std::array<int16_t, 256> map;
+        double a;
+        double b;
+        std::string text;
+    };
+
+    const std::string _ident;
+    const std::string _unit;
+    std::vector<Step> _steps;
+
+    void compile(std::string const& content, std::string const& args);
+};
+
+std::shared_ptr<const Rule> makeRule(
+    std::string ident,
+    std::string content,
+    std::string args,
+    std::string unit);
+
+}
+
+#endif
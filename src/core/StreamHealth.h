@@ -0,0 +1,83 @@
+#ifndef _C2MATICA_STREAMHEALTH_H_
+#define _C2MATICA_STREAMHEALTH_H_
+
+#include <atomic>
+#include <mutex>
+#include <opencv2/core.hpp>
+
+#include "core/Timer.h"
+
+namespace c2matica {
+
+// Health of the captured stream.
+//
+// Frame arrivals are smoothed into an inter-frame interval, a stream
+// arriving much slower than its nominal rate, stalling or failing to
+// decode is degraded. At most once a second a sparse hash of a frame
+// retrieved for the datapoints is taken, a frame not changing a single
+// sampled pixel for freezeTimeout is frozen: the camera or encoder repeats
+// a stale picture while grab() still succeeds. A static screen looks the
+// same, so frozen is only flagged unless reconnectOnFreeze is set.
+class StreamHealth
+{
+public:
+    static const uint32_t DEFAULT_FREEZE_TIMEOUT;
+    static const uint32_t HASH_INTERVAL;
+
+    enum class State
+    {
+        DISCONNECTED,
+        HEALTHY,
+        DEGRADED,
+        FROZEN,
+    };
+
+    struct Policy
+    {
+        uint32_t freezeTimeout;     // ms, 0 never frozen
+        bool reconnectOnFreeze;     // false only flagged
+    };
+
+public:
+    StreamHealth();
+
+    void setPolicy(Policy const& policy);
+    Policy getPolicy();
+
+    void connected(double nominalFPS);
+    void disconnected();
+
+    void onGrab(Timer::steady_time now);
+    void onDecodeError();
+    // the next retrieved frame should be passed to onFrame
+    bool frameDue(Timer::steady_time now);
+    // return true if the stream has just been found frozen
+    bool onFrame(cv::Mat const& frame, Timer::steady_time now);
+
+    // periodic re-evaluation, exports stream.* metrics
+    State update(Timer::steady_time now);
+    State getState() const { return _state.load(); }
+    // arrival rate smoothed over recent grabs, 0 until enough samples
+    double getMeasuredFPS();
+
+    static char const* toString(State state);
+
+private:
+    std::mutex _mutex;
+    Policy _policy;
+    double _nominalInterval;    // ms, 0 unknown
+    double _intervalEwma;       // ms, 0 no sample yet
+    uint32_t _samples;
+    Timer::steady_time _lastGrab;
+    Timer::steady_time _lastHash;
+    Timer::steady_time _unchangedSince;
+    uint64_t _frameHash;
+    uint32_t _decodeErrors;     // since last update
+    std::atomic<State> _state{ State::DISCONNECTED };
+
+    void setState(State state);
+};
+
+}
+
+#endif
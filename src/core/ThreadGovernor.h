@@ -0,0 +1,54 @@
+#ifndef _C2MATICA_THREADGOVERNOR_H_
+#define _C2MATICA_THREADGOVERNOR_H_
+
+#include <string>
+#include <cstddef>
+
+namespace c2matica {
+
+// How the CPUs are shared between recognition jobs (inter-op) and the
+// OpenMP/OpenCV teams inside one job (intra-op).
+//
+// A Tesseract call on a typical HMI ROI (tens of pixels high) runs for a
+// few milliseconds, far too short to amortize waking an OpenMP team, so
+// running one job per core wins as soon as there are about as many
+// datapoints as cores. Only a few large ROIs (e.g. whole screens) leave
+// cores idle without intra-op threads. AUTO picks INTER unless there are
+// fewer datapoints than half the cores and their mean ROI area is at least
+// INTRA_MIN_ROI_AREA pixels.
+enum class Parallelism
+{
+    AUTO,
+    INTER,
+    INTRA,
+};
+
+struct ThreadPlan
+{
+    Parallelism parallelism;
+    std::size_t workers;    // recognition jobs in parallel
+    int ompThreads;         // OpenMP team size per job
+    int cvThreads;          // OpenCV parallel_for threads
+};
+
+static const double INTRA_MIN_ROI_AREA = 250000; // pixels, about 500x500
+
+// "auto", "inter" or "intra", false if unknown
+bool parseParallelism(std::string const& s, Parallelism& out);
+char const* toString(Parallelism parallelism);
+
+// workers is the configured pool size, 0 to derive it from the plan
+ThreadPlan planThreads(
+    Parallelism parallelism,
+    int cpus,
+    std::size_t datapoints,
+    double meanRoiArea,
+    std::size_t workers);
+
+// set process wide OpenCV threads and report the plan, OpenMP teams are
+// bounded by each worker with omp_set_num_threads
+void applyThreadPlan(ThreadPlan const& plan);
+
+}
+
+#endif
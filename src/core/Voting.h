@@ -0,0 +1,45 @@
+#ifndef _C2MATICA_VOTING_H_
+#define _C2MATICA_VOTING_H_
+
+#include <deque>
+#include <string>
+
+namespace c2matica {
+
+// Majority vote over the last reads of one datapoint.
+//
+// A value is emitted only once quorum of the last window reads agree on
+// it, so that a single misread of a flickering digit never reaches the
+// consumer. Weighted, a read votes with its confidence / 100: quorum is
+// met by that many certain reads or by more uncertain ones.
+class Voting
+{
+public:
+    struct Policy
+    {
+        uint32_t window;    // N reads, 0 or 1 no voting
+        uint32_t quorum;    // K agreeing reads
+        bool weighted;
+    };
+
+public:
+    Voting();
+
+    void setPolicy(Policy const& policy);
+    bool enabled() const { return _policy.window > 1; }
+
+    // add a read, return true with the agreed value and its support once
+    // quorum is reached
+    bool vote(std::string const& text, int confidence,
+        std::string& value, double& support);
+    void reset() { _reads.clear(); }
+
+private:
+    Policy _policy;
+    // newest at the back
+    std::deque<std::pair<std::string, double>> _reads;
+};
+
+}
+
+#endif
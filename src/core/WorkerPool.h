@@ -0,0 +1,92 @@
+#ifndef _C2MATICA_WORKERPOOL_H_
+#define _C2MATICA_WORKERPOOL_H_
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+#include "core/Timer.h"
+
+namespace c2matica {
+
+// Work stealing pool running recognition jobs.
+//
+// Jobs are spread round robin on per worker queues, a worker takes jobs
+// from the front of its own queue and steals from the back of the others
+// when it is idle. Each worker limits the OpenMP team it may spawn to
+// ompThreads, so workers * ompThreads does not oversubscribe the CPUs.
+class WorkerPool
+{
+public:
+    typedef std::function<void()> Job;
+
+public:
+    WorkerPool() = delete;
+    // workers 0: availableCpus() / ompThreads
+    WorkerPool(std::size_t workers, int ompThreads = 1);
+    ~WorkerPool();
+
+    bool start();
+    void stop();
+    // rebuild the workers for a new plan, queued jobs are kept
+    void resize(std::size_t workers, int ompThreads);
+
+    // dropped runs instead of job if the pool stops before job is taken
+    void submit(Job job, Job dropped = NULL);
+
+    std::size_t size()
+    {
+        std::shared_lock<std::shared_mutex> l(_workersMutex);
+        return _workers.size();
+    }
+    int getOmpThreads() const { return _ompThreads; }
+
+private:
+    struct Task
+    {
+        Job job;
+        Job dropped;
+    };
+
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<Task> jobs;
+        std::thread thread;
+        // busy time in the current metrics window
+        Timer::steady_clock::duration busy{ 0 };
+        Timer::steady_time windowStart;
+    };
+
+    std::atomic<int> _ompThreads;
+    // held shared by submit, exclusive while resize rebuilds the workers
+    std::shared_mutex _workersMutex;
+    std::vector<std::unique_ptr<Worker>> _workers;
+    std::atomic<std::size_t> _next{ 0 };
+    // may be transiently negative, a job can be taken before counted
+    std::atomic<long> _pending{ 0 };
+    std::atomic<bool> _running{ false };
+
+    std::mutex _mutex;
+    std::condition_variable _cv;
+
+    void createWorkers(std::size_t workers);
+    void join();
+    void loop(std::size_t index);
+    bool take(std::size_t index, Task& task);
+    void updateMetrics(std::size_t index);
+};
+
+std::unique_ptr<WorkerPool> makeWorkerPool(
+    std::size_t workers,
+    int ompThreads = 1);
+
+}
+
+#endif
@@ -2,17 +2,146 @@
 #include <iostream>
 #include <functional>
 #include <chrono>
+#include <cmath>
 #include <exception>
+#include <algorithm>
+#include <variant>
+#include <type_traits>
+#include <opencv2/imgproc.hpp>
+#include <tesseract/resultiterator.h>
 
 #include "3rdparty/easyloggingpp/easylogging++.h"
 #include "3rdparty/nlohmann/json.hpp"
 #include "core/DataPoint.h"
+#include "core/Fingerprint.h"
+#include "utils/Metrics.h"
 
 using json = nlohmann::json;
 
 namespace c2matica {
 
+// metric names, built once instead of per read
+static const std::string FRAME_AGE = "latency.frameAge";
+static const std::string RECOGNIZE = "latency.recognize";
+static const std::string END_TO_END = "latency.endToEnd";
+static const std::string EVENT_SKIPPED = "event.skipped";
+static const std::string EVENT_TRIGGERS = "event.triggers";
+static const std::string EVENT_HEARTBEATS = "event.heartbeats";
+static const std::string RECOGNIZE_READS = "recognize.reads";
+static const std::string RECOGNIZE_REUSED = "recognize.reused";
+static const std::string RECOGNIZE_GRID_CELLS = "recognize.gridCells";
+static const std::string RECOGNIZE_RETRIES = "recognize.retries";
+static const std::string RECOGNIZE_RETRY_WINS = "recognize.retryWins";
+static const std::string POLARITY_CHECKS = "polarity.checks";
+static const std::string SETTLE_DEFERRALS = "settle.deferrals";
+static const std::string SETTLE_FORCED = "settle.forced";
+
+static int64_t epochMs(Timer::system_time const& tp)
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        tp.time_since_epoch()).count();
+}
+
+static double elapsedMs(Timer::system_time const& from,
+                        Timer::system_time const& to)
+{
+    return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+// the value of text after rule, false with error set if the rule failed
+static bool evaluate(Rule const& rule,
+                     std::string const& text,
+                     json& value,
+                     std::string& unit,
+                     std::string& error)
+{
+    Rule::Result result = rule.apply(text);
+    std::visit([&value](auto const& v) {
+        if constexpr (std::is_same_v<std::decay_t<decltype(v)>,
+                                     std::monostate>)
+            value = nullptr;
+        else
+            value = v;
+    }, result.value);
+    unit = result.unit;
+    error = result.error;
+    return result.ok;
+}
+
+// add the timing of a read to j, write it out and record its latency
+static void publish(json& j,
+                    Timer::system_time const& tp,
+                    Ocr::FrameInfo const& frameInfo,
+                    Timer::system_time const& recognizeStart,
+                    Timer::system_time const& recognizeEnd)
+{
+    j["time"] = epochMs(tp);
+    j["captureTime"] = epochMs(frameInfo.arrival);
+    if (frameInfo.pts >= 0)
+        j["pts"] = frameInfo.pts;
+    j["recognizeStart"] = epochMs(recognizeStart);
+    j["recognizeEnd"] = epochMs(recognizeEnd);
+    auto publishTime = Timer::system_clock::now();
+    j["publishTime"] = epochMs(publishTime);
+    std::cout << j << std::endl;
+
+    auto& metrics = Metrics::instance();
+    metrics.observe(FRAME_AGE, elapsedMs(frameInfo.arrival, recognizeStart));
+    metrics.observe(RECOGNIZE, elapsedMs(recognizeStart, recognizeEnd));
+    metrics.observe(END_TO_END, elapsedMs(frameInfo.arrival, publishTime));
+}
+
 const uint32_t DataPoint::DEFAULT_POOLING_INTERVAL = 1000; // ms
+const uint32_t DataPoint::DEFAULT_ADAPTIVE_MAX_INTERVAL = 60000; // ms
+const double DataPoint::DEFAULT_ADAPTIVE_BACKOFF_FACTOR = 1.5;
+const double DataPoint::DEFAULT_ADAPTIVE_STABLE_DISTANCE = 12.0;
+const uint32_t DataPoint::DEFAULT_EVENT_HEARTBEAT = 60000; // ms
+const double DataPoint::MIN_SCALE = 0.25;
+const double DataPoint::MAX_SCALE = 4.0;
+const uint32_t DataPoint::POLARITY_RECHECK_INTERVAL = 60000; // ms
+
+// reads of an unchanged region answered from the last one in a row, then
+// the region is read again
+static const uint32_t MAX_READING_REUSE = 10;
+// a factor this close to 1 is not worth a resize
+static const double SCALE_TOLERANCE = 0.15;
+// rows with this fraction of the peak ink are the x-height band, strokes
+// of ascenders and descenders are sparser
+static const double XHEIGHT_DENSITY = 0.5;
+
+// Estimate the x-height of the text in image from the ink of every row,
+// 0 if there is no text. buffer is scratch memory.
+static int estimateXHeight(cv::Mat const& image, cv::Mat& buffer)
+{
+    if (image.channels() != 1)
+        cv::cvtColor(image, buffer, image.channels() == 4
+            ? cv::COLOR_BGRA2GRAY : cv::COLOR_BGR2GRAY);
+    else
+        image.copyTo(buffer);
+    cv::threshold(buffer, buffer, 0, 1, cv::THRESH_BINARY | cv::THRESH_OTSU);
+    // text is the minority class, whichever its polarity
+    if ((std::size_t)cv::countNonZero(buffer) * 2 > buffer.total())
+        cv::threshold(buffer, buffer, 0, 1, cv::THRESH_BINARY_INV);
+
+    cv::Mat profile;
+    cv::reduce(buffer, profile, 1, cv::REDUCE_SUM, CV_32S);
+    int peak = 0;
+    for (int y = 0; y < profile.rows; y++)
+        peak = std::max(peak, profile.at<int>(y, 0));
+    if (peak == 0)
+        return 0;
+
+    // the tallest dense band, a grid or multi line region has several
+    int dense = std::max(1, (int)(peak * XHEIGHT_DENSITY));
+    int best = 0;
+    int run = 0;
+    for (int y = 0; y < profile.rows; y++)
+    {
+        run = profile.at<int>(y, 0) >= dense ? run + 1 : 0;
+        best = std::max(best, run);
+    }
+    return best;
+}
 
 DataPoint::DataPoint(
     Stoppable* parent,
@@ -24,16 +153,50 @@ DataPoint::DataPoint(
     , _id(id)
     , _dataPath(dataPath)
     , _language(language)
+    , _outvotedMetric("datapoint." + id + ".outvoted")
+    , _scaleMetric("datapoint." + id + ".scale")
+    , _invertedMetric("datapoint." + id + ".inverted")
+    , _deferredMetric("datapoint." + id + ".deferred")
+    , _retriesMetric("datapoint." + id + ".retries")
+    , _roiErrorMetric("datapoint." + id + ".roiError")
     , _ocr(ocr)
+    , _overload(id)
+    , _pool(NULL)
+    , _readDue(std::make_shared<RoiGather::Due>(0))
     , _api(NULL)
 {
     _coordinate = std::make_tuple(0, 0, 0, 0);
+    _roiState = RoiState::VALID;
+    _retry = { 0, -1 };
+    _settle = { 0, 0 };
+    _triggerMode = TriggerMode::POLLING;
+    _eventHeartbeat = DEFAULT_EVENT_HEARTBEAT;
+    _grid = { 0, 0, 0, 0 };
+    _keepOriginalValue = true;
+    _targetXHeight = 0;
+    _polarityDetection = false;
+    _scale = 1;
+    _inverted = false;
+    _readingReuse = 0;
+    _lastVote = { false, "", 0 };
     _pollingInterval = DEFAULT_POOLING_INTERVAL;
+    _adaptiveInterval = DEFAULT_POOLING_INTERVAL;
+    _effectiveInterval = DEFAULT_POOLING_INTERVAL;
+    _adaptive = { false,
+        DEFAULT_ADAPTIVE_MAX_INTERVAL,
+        DEFAULT_ADAPTIVE_BACKOFF_FACTOR,
+        DEFAULT_ADAPTIVE_STABLE_DISTANCE };
 }
 
 DataPoint::~DataPoint()
 {
+    // a queued read holds the datapoint until it ran, its metrics are
+    // gone only after the last one. Datapoints built to carry a modified
+    // config never started, the running one keeps the metrics of the id.
+    bool started = isStart();
     stop();
+    if (started)
+        Metrics::instance().erase("datapoint." + _id + ".");
 }
 
 bool DataPoint::start()
@@ -52,7 +215,7 @@ bool DataPoint::start()
         stop();
         return false;
     }
-    _timer.start(_pollingInterval, true,
+    _timer.start(getEffectiveInterval(), true,
         std::bind(&DataPoint::run, this, std::placeholders::_1));
     return true;
 }
@@ -85,6 +248,15 @@ bool DataPoint::initTessApi()
         _api = NULL;
         return false;
     }
+
+    bool polarityDetection;
+    {
+        std::shared_lock<std::shared_mutex> l(_mutex);
+        polarityDetection = _polarityDetection;
+    }
+    // images come normalized, an inverted second pass is wasted work
+    if (polarityDetection && !_api->SetVariable("tessedit_do_invert", "0"))
+        LOG(WARNING) << _id << " tesseract has no tessedit_do_invert";
     return true;
 }
 
@@ -101,54 +273,660 @@ void DataPoint::releaseTessApi()
 
 void DataPoint::run(Timer::system_time const &tp)
 {
+    auto scheduled = Timer::steady_clock::now();
+    _lastTick.store(scheduled);
+    if (getTriggerMode() == TriggerMode::EVENT && !eventDue(scheduled, false))
+    {
+        Metrics::instance().add(EVENT_SKIPPED);
+        return;
+    }
+    dispatch(tp, scheduled);
+}
+
+void DataPoint::trigger(uint64_t changes)
+{
+    // without a pool the timer thread reads on its next tick
+    if (!_pool || !isStart() || isStop())
+        return;
+
+    auto now = Timer::steady_clock::now();
+    if (!eventDue(now, true, changes))
+        return;
+
+    Metrics::instance().add(EVENT_TRIGGERS);
+    dispatch(Timer::system_clock::now(), now);
+}
+
+bool DataPoint::eventDue(
+    Timer::steady_time now,
+    bool triggered,
+    uint64_t changes)
+{
+    // spaced by the configured interval, the effective one is stretched
+    // by adaptive polling and demotion to up to a minute
+    auto since = now - _eventDispatchedAt.load();
+    if (triggered &&
+        since < std::chrono::milliseconds(_pollingInterval.load()))
+        return false;
+
+    uint32_t heartbeat = _eventHeartbeat.load();
+    bool due = heartbeat > 0 && since >= std::chrono::milliseconds(heartbeat);
+    if (due)
+    {
+        if (!triggered)
+            Metrics::instance().add(EVENT_HEARTBEATS);
+    }
+    else if (triggered)
+    {
+        due = changes != _eventReadChanges.load();
+    }
+    else
+    {
+        // a region not gathered is not tracked, it is polled
+        cv::Rect rect = getRoi();
+        RoiGather::RegionState state;
+        due = rect.empty() || !_ocr->getRoiState(_id, rect, state) ||
+            state.changes != _eventReadChanges.load();
+    }
+    if (due)
+        _eventDispatchedAt.store(now);
+    return due;
+}
+
+void DataPoint::dispatch(
+    Timer::system_time const &tp,
+    Timer::steady_time scheduled)
+{
+    // gathered from now on until the read took it
+    _readDue->store(0);
+    if (!_pool)
+    {
+        process(tp, scheduled);
+        return;
+    }
+
+    if (_busy.exchange(true))
+    {
+        _overload.dropBusy();
+        return;
+    }
+
+    std::weak_ptr<DataPoint> weak = weak_from_this();
+    _pool->submit([weak, tp, scheduled]() {
+        if (auto self = weak.lock())
+        {
+            self->process(tp, scheduled);
+            self->_busy.store(false);
+        }
+    }, [weak]() {
+        // never ran, the next dispatch after a restart must not be dropped
+        if (auto self = weak.lock())
+            self->_busy.store(false);
+    });
+}
+
+void DataPoint::process(
+    Timer::system_time const &tp,
+    Timer::steady_time scheduled)
+{
+    uint32_t interval = getEffectiveInterval();
+
+    bool overloadChanged = _overload.checkPromote();
+    if (_overload.admit(scheduled, interval))
+    {
+        recognize(tp);
+        overloadChanged |= _overload.complete(scheduled, interval);
+    }
+
+    if (overloadChanged)
+    {
+        bool changed;
+        {
+            std::unique_lock<std::shared_mutex> l(_mutex);
+            changed = updateEffectiveInterval();
+        }
+        if (changed)
+            _ocr->requestCalcOutFPS();
+    }
+}
+
+void DataPoint::recognize(Timer::system_time const &tp)
+{
+    // the engine is released on stop while a job may still be queued
+    std::lock_guard<std::recursive_mutex> l(_rMutex);
+    if (!_api)
+        return;
+
+    Ocr::FrameInfo frameInfo;
+    auto recognizeStart = Timer::system_clock::now();
+
+    RoiState roiState;
+    cv::Rect rect = getRoi(&roiState);
+    if (roiState == RoiState::INVALID)
+        return;
+    bool crop = !rect.empty();
+
+    // read the region gathered by the capture thread, the full frame is
+    // copied only without a region or until the region is gathered
+    std::shared_ptr<const RoiGather::Arena> arena;
     cv::Mat frame;
+    RoiGather::RegionState regionState{ 0, 0 };
+    if (crop &&
+        _ocr->getRoi(_id, rect, arena, frame, &frameInfo, &regionState))
+    {
+        if (!settled(regionState.stableMs))
+            return;
+        // the change is consumed, event mode reads again on the next one
+        _eventReadChanges.store(regionState.changes);
+    }
+    else if (crop && _ocr->isRectified())
+    {
+        // a region of the rectified view is only read once gathered
+        LOG(DEBUG) << _id << " region not gathered yet";
+        return;
+    }
+    else
+    {
+        if (!_ocr->getFrame(_frameBuffer, &frameInfo) || _frameBuffer.empty())
+        {
+            // expected while the stream is (re)connecting
+            if (_ocr->isOpened())
+                LOG(ERROR) << _id << " blank frame grabbed";
+            else
+                LOG(DEBUG) << _id << " no frame, stream not connected";
+            return;
+        }
+        // not validated yet, or the resolution changed since
+        if (crop && (rect & cv::Rect(0, 0, _frameBuffer.cols,
+                _frameBuffer.rows)) != rect)
+        {
+            LOG(DEBUG) << _id << " region outside the "
+                << _frameBuffer.cols << "x" << _frameBuffer.rows << " frame";
+            return;
+        }
+        frame = crop ? _frameBuffer(rect) : _frameBuffer;
+    }
+    // the next tick at the earliest, adaptive polling and demotion only
+    // stretch the interval
+    _readDue->store(RoiGather::dueOf(_lastTick.load()
+        + std::chrono::milliseconds(getPollingInterval())));
 
-    if (!_ocr->getFrame(frame) || frame.empty())
+    double stableDistance;
+    Grid grid;
+    cv::Point clip;
     {
-        LOG(ERROR) << _id << " blank frame grabbed";
+        std::shared_lock<std::shared_mutex> l(_mutex);
+        if (_adaptive.enabled || _voting.enabled())
+            fingerprint(frame, _thumbnail);
+        else
+            _thumbnail.release();
+        stableDistance = _adaptive.stableDistance;
+        grid = _grid;
+        clip = _roiClip;
+    }
+
+    double scale;
+    cv::Mat const& image = normalizePolarity(rescale(frame, scale));
+    if (grid.enabled())
+    {
+        recognizeGrid(image, grid, clip, scale, _thumbnail,
+            tp, frameInfo, recognizeStart);
         return;
     }
-    auto coordinate = getCoordinate();
-    uint32_t x = std::get<0>(coordinate);
-    uint32_t y = std::get<1>(coordinate);
-    uint32_t width = std::get<2>(coordinate);
-    uint32_t height = std::get<3>(coordinate);
 
-    if (width > 0 && height > 0)
+    Reading reading;
+    bool reused = _voting.enabled() && !_lastReadFingerprint.empty() &&
+        _readingReuse < MAX_READING_REUSE &&
+        fingerprintDistance(_thumbnail, _lastReadFingerprint) <= stableDistance;
+    if (reused)
     {
-        cv::Rect rect(x, y, width, height);
-        frame = frame(rect);
+        // the region did not change since the last read, it stands
+        reading = _lastReading;
+        _readingReuse++;
+        Metrics::instance().add(RECOGNIZE_REUSED);
+    }
+    else
+    {
+        readWithRetry(image, reading);
+        // boxes in region coordinates
+        if (scale != 1)
+        {
+            for (auto& word : reading.words)
+                word.box = cv::Rect(std::lround(word.box.x / scale),
+                    std::lround(word.box.y / scale),
+                    std::lround(word.box.width / scale),
+                    std::lround(word.box.height / scale));
+        }
+        if (_voting.enabled())
+        {
+            _lastReading = reading;
+            _thumbnail.copyTo(_lastReadFingerprint);
+            _readingReuse = 0;
+        }
     }
 
-    _api->SetImage(
-        (uchar*)frame.data,
-        frame.size().width,
-        frame.size().height,
-        frame.channels(),
-        frame.step1());
-    // char* out = _api->GetUNLVText();
-    char* out = _api->GetUTF8Text();
-    std::string stringOut = std::string(out);
-    if (stringOut.length() > 0 && stringOut.back() == '\n')
+    auto recognizeEnd = Timer::system_clock::now();
+
+    adapt(reading.text, _thumbnail);
+
+    std::string stringOut = reading.text;
+    double support = 0;
+    if (reused)
     {
-        stringOut.erase(stringOut.find_last_not_of("\n") + 1);
+        // a reused reading repeats the outcome of its vote, voting again
+        // would copy a misread until it meets the quorum
+        if (!_lastVote.agreed)
+            return;
+        stringOut = _lastVote.value;
+        support = _lastVote.support;
+    }
+    else if (_voting.enabled())
+    {
+        _lastVote.agreed = _voting.vote(reading.text, reading.confidence,
+            stringOut, support);
+        if (!_lastVote.agreed)
+        {
+            LOG(TRACE) << _id << " `" << reading.text << "' outvoted, "
+                << "best `" << stringOut << "' with " << support;
+            Metrics::instance().add(_outvotedMetric);
+            return;
+        }
+        _lastVote.value = stringOut;
+        _lastVote.support = support;
     }
 
     try
     {
         json j;
         j["dpId"] = _id;
-        j["time"] = std::chrono::duration_cast<std::chrono::milliseconds>(
-            tp.time_since_epoch()).count();
-        j["value"] = stringOut;
-        std::cout << j << std::endl;
+        j["quality"] = StreamHealth::toString(_ocr->getHealth());
+        j["confidence"] = reading.confidence;
+        if (_voting.enabled())
+            j["votes"] = support;
+        json words = json::array();
+        for (auto const& word : reading.words)
+        {
+            words.push_back({
+                { "text", word.text },
+                { "confidence", word.confidence },
+                { "box", { word.box.x, word.box.y,
+                           word.box.width, word.box.height } } });
+        }
+        j["words"] = std::move(words);
+        if (auto rule = getRule(); rule)
+        {
+            std::string unit;
+            std::string error;
+            if (!evaluate(*rule, stringOut, j["value"], unit, error))
+            {
+                LOG(DEBUG) << _id << " rule " << rule->getIdent()
+                    << " failed on `" << stringOut << "': " << error;
+                j["error"] = error;
+            }
+            if (_keepOriginalValue)
+                j["rawValue"] = stringOut;
+            if (!unit.empty())
+                j["unit"] = unit;
+        }
+        else
+        {
+            j["value"] = stringOut;
+            if (auto error = getRuleError(); !error.empty())
+                j["error"] = error;
+        }
+        publish(j, tp, frameInfo, recognizeStart, recognizeEnd);
+    }
+    catch (std::exception& e)
+    {
+        LOG(ERROR) << _id << " parse out exception: " << e.what();
+    }
+}
+
+void DataPoint::recognizeGrid(
+    cv::Mat const& frame,
+    Grid const& grid,
+    cv::Point const& clip,
+    double scale,
+    cv::Mat& thumbnail,
+    Timer::system_time const& tp,
+    Ocr::FrameInfo const& frameInfo,
+    Timer::system_time const& recognizeStart)
+{
+    std::vector<Reading> cells;
+    readGrid(frame, grid, clip, scale, cells);
+    auto recognizeEnd = Timer::system_clock::now();
+
+    std::string text;
+    for (auto const& cell : cells)
+        text += cell.text + '\n';
+    adapt(text, thumbnail);
+
+    try
+    {
+        json j;
+        j["dpId"] = _id;
+        j["quality"] = StreamHealth::toString(_ocr->getHealth());
+        auto rule = getRule();
+        json values = json::array();
+        json rawValues = json::array();
+        json confidences = json::array();
+        std::string unit;
+        for (uint32_t r = 0; r < grid.rows; r++)
+        {
+            json valueRow = json::array();
+            json rawRow = json::array();
+            json confidenceRow = json::array();
+            for (uint32_t c = 0; c < grid.cols; c++)
+            {
+                Reading const& cell = cells[r * grid.cols + c];
+                confidenceRow.push_back(cell.confidence);
+                if (!rule)
+                {
+                    valueRow.push_back(cell.text);
+                    continue;
+                }
+
+                json value;
+                std::string error;
+                if (!evaluate(*rule, cell.text, value, unit, error))
+                {
+                    LOG(DEBUG) << _id << " rule " << rule->getIdent()
+                        << " failed on cell " << r << "," << c << " `"
+                        << cell.text << "': " << error;
+                    if (!j.contains("error"))
+                        j["error"] = "cell " + std::to_string(r) + ","
+                            + std::to_string(c) + ": " + error;
+                }
+                valueRow.push_back(std::move(value));
+                rawRow.push_back(cell.text);
+            }
+            values.push_back(std::move(valueRow));
+            confidences.push_back(std::move(confidenceRow));
+            if (rule)
+                rawValues.push_back(std::move(rawRow));
+        }
+        j["value"] = std::move(values);
+        j["confidence"] = std::move(confidences);
+        if (rule)
+        {
+            if (_keepOriginalValue)
+                j["rawValue"] = std::move(rawValues);
+            if (!unit.empty())
+                j["unit"] = unit;
+        }
+        else if (auto error = getRuleError(); !error.empty())
+        {
+            j["error"] = error;
+        }
+        publish(j, tp, frameInfo, recognizeStart, recognizeEnd);
     }
     catch (std::exception& e)
     {
         LOG(ERROR) << _id << " parse out exception: " << e.what();
     }
-    
+}
+
+cv::Mat const& DataPoint::rescale(cv::Mat const& image, double& factor)
+{
+    uint32_t target;
+    {
+        std::shared_lock<std::shared_mutex> l(_mutex);
+        target = _targetXHeight;
+    }
+
+    factor = 1;
+    if (target == 0)
+        return image;
+
+    if (image.size() != _scaleGeometry)
+    {
+        int xHeight = estimateXHeight(image, _scaleBuffer);
+        // nothing to measure yet, e.g. a blank display, estimate again
+        // on the next read
+        if (xHeight == 0)
+            return image;
+
+        _scale = std::clamp((double)target / xHeight, MIN_SCALE, MAX_SCALE);
+        if (std::abs(_scale - 1) < SCALE_TOLERANCE)
+            _scale = 1;
+        _scaleGeometry = image.size();
+        LOG(DEBUG) << _id << " x-height " << xHeight << "px, scale "
+            << _scale;
+        Metrics::instance().set(_scaleMetric, _scale);
+    }
+
+    if (_scale == 1)
+        return image;
+    factor = _scale;
+    // linear is enough to enlarge strokes, area averages when shrinking
+    cv::resize(image, _scaleBuffer, cv::Size(), factor, factor,
+        factor > 1 ? cv::INTER_LINEAR : cv::INTER_AREA);
+    return _scaleBuffer;
+}
+
+cv::Mat const& DataPoint::normalizePolarity(cv::Mat const& image)
+{
+    bool enabled;
+    {
+        std::shared_lock<std::shared_mutex> l(_mutex);
+        enabled = _polarityDetection;
+    }
+    if (!enabled)
+        return image;
+
+    auto now = Timer::steady_clock::now();
+    if (image.size() != _polarityGeometry ||
+        now - _polarityCheckedAt
+            >= std::chrono::milliseconds(POLARITY_RECHECK_INTERVAL))
+    {
+        cv::Mat const* gray = &image;
+        if (image.channels() != 1)
+        {
+            cv::cvtColor(image, _polarityBuffer, image.channels() == 4
+                ? cv::COLOR_BGRA2GRAY : cv::COLOR_BGR2GRAY);
+            gray = &_polarityBuffer;
+        }
+        // text is the minority class, a mean below the Otsu split means
+        // the background is the dark side
+        double mean = cv::mean(*gray)[0];
+        double split = cv::threshold(*gray, _polarityBuffer, 0, 255,
+            cv::THRESH_BINARY | cv::THRESH_OTSU);
+        bool inverted = mean < split;
+        if (inverted != _inverted)
+            LOG(DEBUG) << _id << " polarity "
+                << (inverted ? "light on dark" : "dark on light");
+        _inverted = inverted;
+        _polarityGeometry = image.size();
+        _polarityCheckedAt = now;
+        auto& metrics = Metrics::instance();
+        metrics.add(POLARITY_CHECKS);
+        metrics.set(_invertedMetric, inverted ? 1 : 0);
+    }
+
+    if (!_inverted)
+        return image;
+    cv::bitwise_not(image, _polarityBuffer);
+    return _polarityBuffer;
+}
+
+bool DataPoint::settled(uint32_t stableMs)
+{
+    SettlePolicy settle;
+    {
+        std::shared_lock<std::shared_mutex> l(_mutex);
+        settle = _settle;
+    }
+
+    if (settle.settleTime == 0 || stableMs >= settle.settleTime)
+    {
+        _deferredSince = Timer::steady_time();
+        return true;
+    }
+
+    auto now = Timer::steady_clock::now();
+    if (_deferredSince == Timer::steady_time())
+        _deferredSince = now;
+    auto& metrics = Metrics::instance();
+    if (now - _deferredSince < std::chrono::milliseconds(settle.maxDeferral))
+    {
+        LOG(TRACE) << _id << " region changed " << stableMs << "ms ago, defer";
+        metrics.add(SETTLE_DEFERRALS);
+        metrics.add(_deferredMetric);
+        return false;
+    }
+
+    LOG(DEBUG) << _id << " region not settled after "
+        << settle.maxDeferral << "ms, read anyway";
+    metrics.add(SETTLE_FORCED);
+    _deferredSince = Timer::steady_time();
+    return true;
+}
+
+void DataPoint::read(cv::Mat const& image, Reading& reading)
+{
+    _api->SetImage(
+        (uchar*)image.data,
+        image.size().width,
+        image.size().height,
+        image.channels(),
+        image.step1());
+    // char* out = _api->GetUNLVText();
+    char* out = _api->GetUTF8Text();
+    reading.text = out ? out : "";
     delete[] out;
+    if (reading.text.length() > 0 && reading.text.back() == '\n')
+    {
+        reading.text.erase(reading.text.find_last_not_of("\n") + 1);
+    }
+
+    reading.confidence = _api->MeanTextConf();
+    reading.words.clear();
+    tesseract::ResultIterator* iter = _api->GetIterator();
+    if (!iter)
+        return;
+
+    auto const level = tesseract::RIL_WORD;
+    do
+    {
+        if (iter->Empty(level))
+            continue;
+
+        char* word = iter->GetUTF8Text(level);
+        int left, top, right, bottom;
+        iter->BoundingBox(level, &left, &top, &right, &bottom);
+        reading.words.push_back({ word ? word : "",
+            iter->Confidence(level),
+            cv::Rect(left, top, right - left, bottom - top) });
+        delete[] word;
+    } while (iter->Next(level));
+    delete iter;
+}
+
+void DataPoint::readGrid(
+    cv::Mat const& image,
+    Grid const& grid,
+    cv::Point const& clip,
+    double scale,
+    std::vector<Reading>& cells)
+{
+    auto& metrics = Metrics::instance();
+    metrics.add(RECOGNIZE_READS);
+    metrics.add(RECOGNIZE_GRID_CELLS, grid.rows * grid.cols);
+
+    // binarized once with Otsu over the whole grid, cells are rectangles
+    // of it, each read as a single line. Tesseract thresholds every
+    // rectangle again, but only has two gray levels left to split.
+    cv::Mat const* gray = &image;
+    if (image.channels() != 1)
+    {
+        cv::cvtColor(image, _gridBuffer, image.channels() == 4
+            ? cv::COLOR_BGRA2GRAY : cv::COLOR_BGR2GRAY);
+        gray = &_gridBuffer;
+    }
+    cv::threshold(*gray, _gridBuffer, 0, 255,
+        cv::THRESH_BINARY | cv::THRESH_OTSU);
+    _api->SetImage(
+        _gridBuffer.data,
+        _gridBuffer.cols,
+        _gridBuffer.rows,
+        1,
+        _gridBuffer.step1());
+    auto psm = _api->GetPageSegMode();
+    _api->SetPageSegMode(tesseract::PSM_SINGLE_LINE);
+
+    cells.assign((std::size_t)grid.rows * grid.cols, Reading{ "", 0, {} });
+    cv::Rect bounds(0, 0, image.cols, image.rows);
+    for (uint32_t r = 0; r < grid.rows; r++)
+    {
+        for (uint32_t c = 0; c < grid.cols; c++)
+        {
+            // a clamped region cuts the cells at the frame edge, the grid
+            // keeps its place when the left or top edge was cut
+            int left = std::lround(
+                ((double)c * grid.cellWidth - clip.x) * scale);
+            int top = std::lround(
+                ((double)r * grid.cellHeight - clip.y) * scale);
+            cv::Rect rect = cv::Rect(left, top,
+                std::lround(((c + 1.0) * grid.cellWidth - clip.x) * scale) - left,
+                std::lround(((r + 1.0) * grid.cellHeight - clip.y) * scale) - top)
+                & bounds;
+            if (rect.empty())
+                continue;
+
+            Reading& cell = cells[r * grid.cols + c];
+            _api->SetRectangle(rect.x, rect.y, rect.width, rect.height);
+            char* out = _api->GetUTF8Text();
+            cell.text = out ? out : "";
+            delete[] out;
+            cell.text.erase(cell.text.find_last_not_of(" \n") + 1);
+            cell.confidence = _api->MeanTextConf();
+        }
+    }
+    _api->SetPageSegMode(psm);
+}
+
+void DataPoint::readWithRetry(cv::Mat const& image, Reading& reading)
+{
+    RetryPolicy retry;
+    {
+        std::shared_lock<std::shared_mutex> l(_mutex);
+        retry = _retry;
+    }
+
+    auto& metrics = Metrics::instance();
+    metrics.add(RECOGNIZE_READS);
+    read(image, reading);
+    if (retry.minConfidence == 0 ||
+        reading.confidence >= (int)retry.minConfidence)
+        return;
+
+    // hard read, binarize and try again
+    metrics.add(RECOGNIZE_RETRIES);
+    metrics.add(_retriesMetric);
+    cv::Mat const* gray = &image;
+    if (image.channels() != 1)
+    {
+        cv::cvtColor(image, _retryBuffer, image.channels() == 4
+            ? cv::COLOR_BGRA2GRAY : cv::COLOR_BGR2GRAY);
+        gray = &_retryBuffer;
+    }
+    cv::threshold(*gray, _retryBuffer, 0, 255,
+        cv::THRESH_BINARY | cv::THRESH_OTSU);
+
+    auto psm = _api->GetPageSegMode();
+    if (retry.alternatePsm >= 0)
+        _api->SetPageSegMode((tesseract::PageSegMode)retry.alternatePsm);
+    Reading second;
+    read(_retryBuffer, second);
+    _api->SetPageSegMode(psm);
+
+    LOG(DEBUG) << _id << " retry confidence " << reading.confidence
+        << " -> " << second.confidence;
+    if (second.confidence > reading.confidence)
+    {
+        metrics.add(RECOGNIZE_RETRY_WINS);
+        reading = std::move(second);
+    }
 }
 
 void DataPoint::setPollingInterval(uint32_t poolingInterval)
@@ -164,11 +942,148 @@ void DataPoint::setPollingInterval(uint32_t poolingInterval)
         return;
 
     _pollingInterval = poolingInterval;
+    _adaptiveInterval = poolingInterval;
+    updateEffectiveInterval();
+}
+
+void DataPoint::setAdaptivePolling(AdaptivePolling const& adaptive)
+{
+    std::unique_lock<std::shared_mutex> l(_mutex);
+    _adaptive = adaptive;
+    if (_adaptive.backoffFactor < 1)
+        _adaptive.backoffFactor = 1;
+    if (!_adaptive.enabled)
+    {
+        _adaptiveInterval = _pollingInterval;
+        updateEffectiveInterval();
+    }
+}
+
+void DataPoint::adapt(std::string const& value, cv::Mat& fingerprint)
+{
+    {
+        std::unique_lock<std::shared_mutex> l(_mutex);
+        if (!_adaptive.enabled)
+            return;
+
+        bool stable = value == _lastValue &&
+            fingerprintDistance(fingerprint, _lastFingerprint)
+                <= _adaptive.stableDistance;
+        _lastValue = value;
+        cv::swap(_lastFingerprint, fingerprint);
 
+        uint32_t maxInterval =
+            std::max(_adaptive.maxInterval, _pollingInterval.load());
+        uint32_t adaptiveInterval = stable
+            ? std::min<double>(maxInterval,
+                  std::ceil(_adaptiveInterval * _adaptive.backoffFactor))
+            : _pollingInterval.load();
+        if (adaptiveInterval == _adaptiveInterval)
+            return;
+
+        LOG(DEBUG) << _id << " adaptive polling interval "
+            << _adaptiveInterval << " -> " << adaptiveInterval;
+        _adaptiveInterval = adaptiveInterval;
+        if (!updateEffectiveInterval())
+            return;
+    }
+
+    _ocr->requestCalcOutFPS();
+}
+
+void DataPoint::validateRoi()
+{
+    auto [x, y, width, height] = _coordinate;
+    RoiState state = RoiState::VALID;
+    cv::Rect roi;
+    cv::Point clip(0, 0);
+    if (width > 0 && height > 0)
+    {
+        // 64 bit, a huge coordinate must not wrap into the frame
+        int64_t left = (int64_t)x + _offset.x;
+        int64_t top = (int64_t)y + _offset.y;
+        int64_t right = left + width;
+        int64_t bottom = top + height;
+        if (_frameSize.empty())
+        {
+            state = RoiState::UNKNOWN;
+            roi = cv::Rect(x, y, width, height);
+        }
+        else if (left >= _frameSize.width || top >= _frameSize.height ||
+                 right <= 0 || bottom <= 0)
+        {
+            state = RoiState::INVALID;
+        }
+        else
+        {
+            // shifted by drift, the region may leave the frame on any side
+            int64_t clampedLeft = std::max<int64_t>(left, 0);
+            int64_t clampedTop = std::max<int64_t>(top, 0);
+            roi = cv::Rect(clampedLeft, clampedTop,
+                std::min<int64_t>(right, _frameSize.width) - clampedLeft,
+                std::min<int64_t>(bottom, _frameSize.height) - clampedTop);
+            clip = cv::Point(clampedLeft - left, clampedTop - top);
+            state = roi.width == (int64_t)width && roi.height == (int64_t)height
+                ? RoiState::VALID
+                : RoiState::CLAMPED;
+        }
+    }
+
+    if (state != _roiState && !_frameSize.empty())
+    {
+        if (state == RoiState::INVALID)
+            LOG(ERROR) << _id << " coordinate x:" << x << " y:" << y
+                << " outside the " << _frameSize.width << "x"
+                << _frameSize.height << " frame, not recognized";
+        else if (state == RoiState::CLAMPED)
+            LOG(WARNING) << _id << " coordinate x:" << x << " y:" << y
+                << " width:" << width << " height:" << height
+                << " clamped to the " << _frameSize.width << "x"
+                << _frameSize.height << " frame";
+    }
+    _roi = roi;
+    _roiClip = clip;
+    _roiState = state;
+    if (_frameSize.empty())
+        return;
+    // 0 valid, 1 clamped, 2 invalid
+    Metrics::instance().set(_roiErrorMetric,
+        state == RoiState::INVALID ? 2 : (state == RoiState::CLAMPED ? 1 : 0));
+}
+
+bool DataPoint::updateEffectiveInterval()
+{
+    uint32_t effectiveInterval = _adaptiveInterval * _overload.multiplier();
+    if (effectiveInterval == _effectiveInterval)
+        return false;
+
+    _effectiveInterval = effectiveInterval;
     if (_timer.isStart())
+        _timer.setInterval(_effectiveInterval);
+    return true;
+}
+
+char const* DataPoint::toString(TriggerMode mode)
+{
+    switch (mode)
     {
-        _timer.setInterval(_pollingInterval);
+        case TriggerMode::POLLING:
+            return "polling";
+        case TriggerMode::EVENT:
+            return "event";
     }
+    return "unknown";
+}
+
+bool DataPoint::parseTriggerMode(std::string const& name, TriggerMode& mode)
+{
+    if (name == "polling")
+        mode = TriggerMode::POLLING;
+    else if (name == "event")
+        mode = TriggerMode::EVENT;
+    else
+        return false;
+    return true;
 }
 
 // -----------------------------------------------------------------------
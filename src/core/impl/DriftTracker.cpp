@@ -0,0 +1,143 @@
+#include <algorithm>
+#include <chrono>
+#include <opencv2/imgproc.hpp>
+
+#include "3rdparty/easyloggingpp/easylogging++.h"
+#include "core/DriftTracker.h"
+#include "utils/Metrics.h"
+
+namespace c2matica {
+
+const uint32_t DriftTracker::DEFAULT_CHECK_INTERVAL = 10000; // ms
+const int32_t DriftTracker::DEFAULT_SEARCH_RADIUS = 16; // px
+const double DriftTracker::DEFAULT_MIN_SCORE = 0.6;
+
+DriftTracker::DriftTracker()
+    : _offset(0, 0)
+{
+    _policy = { {}, DEFAULT_CHECK_INTERVAL, DEFAULT_SEARCH_RADIUS,
+        DEFAULT_MIN_SCORE };
+}
+
+void DriftTracker::setPolicy(Policy const& policy)
+{
+    _policy = policy;
+    if (_policy.searchRadius < 1)
+        _policy.searchRadius = 1;
+    // taken again from the next frame
+    _anchors.clear();
+    _frameSize = cv::Size();
+    _offset = cv::Point(0, 0);
+    _lastCheck = Timer::steady_time();
+}
+
+bool DriftTracker::due(Timer::steady_time now) const
+{
+    return enabled() && now - _lastCheck
+        >= std::chrono::milliseconds(_policy.checkInterval);
+}
+
+void DriftTracker::toGray(cv::Mat const& image, cv::Mat& gray)
+{
+    if (image.channels() == 1)
+        image.copyTo(gray);
+    else
+        cv::cvtColor(image, gray, image.channels() == 4
+            ? cv::COLOR_BGRA2GRAY : cv::COLOR_BGR2GRAY);
+}
+
+void DriftTracker::capture(cv::Mat const& frame)
+{
+    cv::Rect bounds(0, 0, frame.cols, frame.rows);
+    _anchors.clear();
+    for (auto const& rect : _policy.anchors)
+    {
+        if (rect.empty() || (rect & bounds) != rect)
+        {
+            LOG(WARNING) << "drift anchor x:" << rect.x << " y:" << rect.y
+                << " width:" << rect.width << " height:" << rect.height
+                << " outside the " << frame.cols << "x" << frame.rows
+                << " frame, ignored";
+            continue;
+        }
+        Anchor anchor{ rect, cv::Mat() };
+        toGray(frame(rect), anchor.templ);
+        _anchors.push_back(std::move(anchor));
+    }
+    LOG(INFO) << "drift anchors captured, " << _anchors.size() << " of "
+        << _policy.anchors.size();
+}
+
+bool DriftTracker::update(cv::Mat const& frame, Timer::steady_time now)
+{
+    _lastCheck = now;
+    if (frame.empty())
+        return false;
+
+    // templates belong to one geometry, the view is where they were taken
+    if (frame.size() != _frameSize)
+    {
+        _frameSize = frame.size();
+        capture(frame);
+        bool changed = _offset != cv::Point(0, 0);
+        _offset = cv::Point(0, 0);
+        Metrics::instance().set("drift.offsetX", 0);
+        Metrics::instance().set("drift.offsetY", 0);
+        return changed;
+    }
+
+    auto startTime = std::chrono::steady_clock::now();
+    cv::Rect bounds(0, 0, frame.cols, frame.rows);
+    int radius = _policy.searchRadius;
+    std::vector<int> dx;
+    std::vector<int> dy;
+    for (auto const& anchor : _anchors)
+    {
+        cv::Rect expected = anchor.rect + _offset;
+        cv::Rect window = cv::Rect(expected.x - radius, expected.y - radius,
+            expected.width + 2 * radius, expected.height + 2 * radius) & bounds;
+        if (window.width < anchor.templ.cols ||
+            window.height < anchor.templ.rows)
+            continue;
+
+        toGray(frame(window), _window);
+        cv::matchTemplate(_window, anchor.templ, _result, cv::TM_CCOEFF_NORMED);
+        double score;
+        cv::Point location;
+        cv::minMaxLoc(_result, NULL, &score, NULL, &location);
+        if (score < _policy.minScore)
+            continue;
+        dx.push_back(window.x + location.x - anchor.rect.x);
+        dy.push_back(window.y + location.y - anchor.rect.y);
+    }
+
+    auto& metrics = Metrics::instance();
+    metrics.set("drift.anchorsFound", dx.size());
+    metrics.set("drift.checkUs",
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - startTime).count());
+    if (dx.empty())
+    {
+        // occluded or changed beyond the radius, keep the last offset
+        metrics.add("drift.lost");
+        return false;
+    }
+
+    // the median keeps an anchor covered by a moving object from pulling
+    auto median = [](std::vector<int>& v) {
+        std::nth_element(v.begin(), v.begin() + v.size() / 2, v.end());
+        return v[v.size() / 2];
+    };
+    cv::Point offset(median(dx), median(dy));
+    if (offset == _offset)
+        return false;
+
+    LOG(WARNING) << "camera view drifted to x:" << offset.x
+        << " y:" << offset.y << ", " << dx.size() << " anchors found";
+    _offset = offset;
+    metrics.set("drift.offsetX", offset.x);
+    metrics.set("drift.offsetY", offset.y);
+    return true;
+}
+
+}
@@ -0,0 +1,38 @@
+#include <opencv2/imgproc.hpp>
+
+#include "core/Fingerprint.h"
+
+namespace c2matica {
+
+void fingerprint(cv::Mat const& image, cv::Mat& thumbnail)
+{
+    if (image.empty())
+    {
+        thumbnail.release();
+        return;
+    }
+
+    cv::Size size(FINGERPRINT_SIZE, FINGERPRINT_SIZE);
+    if (image.channels() == 1)
+    {
+        cv::resize(image, thumbnail, size, 0, 0, cv::INTER_AREA);
+        return;
+    }
+
+    // shrunk before the conversion, the scratch has the thumbnail size
+    // whatever the region and is not allocated again
+    thread_local cv::Mat small;
+    cv::resize(image, small, size, 0, 0, cv::INTER_AREA);
+    cv::cvtColor(small, thumbnail, image.channels() == 4
+        ? cv::COLOR_BGRA2GRAY : cv::COLOR_BGR2GRAY);
+}
+
+double fingerprintDistance(cv::Mat const& a, cv::Mat const& b)
+{
+    if (a.empty() || b.empty() || a.size() != b.size())
+        return 255;
+
+    return cv::norm(a, b, cv::NORM_INF);
+}
+
+}
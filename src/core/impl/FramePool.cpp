@@ -0,0 +1,188 @@
+#include <sys/mman.h>
+#include <cstring>
+#include <cerrno>
+
+#include "3rdparty/easyloggingpp/easylogging++.h"
+#include "core/FramePool.h"
+#include "utils/Metrics.h"
+
+namespace c2matica {
+
+const std::size_t FramePool::DEFAULT_COUNT = 4;
+
+static const std::size_t BUFFER_ALIGN = 4096;
+static const std::size_t HUGE_PAGE_SIZE = 2 << 20;
+// metric name, built once instead of per frame
+static const std::string EXHAUSTED = "framePool.exhausted";
+
+static std::size_t alignUp(std::size_t n, std::size_t align)
+{
+    return (n + align - 1) / align * align;
+}
+
+FramePool::FramePool(std::size_t count)
+    : _buffers(count)
+    , _next(new std::atomic<uint32_t>[count])
+    , _head(0)
+    , _outstanding(0)
+    , _type(-1)
+    , _hugePages(false)
+    , _memory(NULL)
+    , _mapped(0)
+{
+    for (std::size_t i = 0; i < count; i++)
+    {
+        _buffers[i].data = NULL;
+        _buffers[i].index = i;
+    }
+}
+
+FramePool::~FramePool()
+{
+    if (_outstanding.load() != 0)
+        LOG(ERROR) << "frame pool destroyed with "
+            << _outstanding.load() << " buffers in use";
+    unmap();
+}
+
+void FramePool::unmap()
+{
+    for (auto& buffer : _buffers)
+    {
+        buffer.mat.release();
+        buffer.data = NULL;
+    }
+    if (_memory)
+        munmap(_memory, _mapped);
+    _memory = NULL;
+    _mapped = 0;
+    _head.store(0);
+}
+
+bool FramePool::fits(cv::Size size, int type) const
+{
+    return _memory && size == _size && type == _type;
+}
+
+bool FramePool::reset(cv::Size size, int type)
+{
+    if (_outstanding.load() != 0)
+    {
+        LOG(ERROR) << "frame pool reset with "
+            << _outstanding.load() << " buffers in use";
+        return false;
+    }
+
+    unmap();
+
+    cv::Mat probe(1, 1, type);
+    std::size_t bufferBytes = alignUp(
+        (std::size_t)size.width * size.height * probe.elemSize(), BUFFER_ALIGN);
+    std::size_t bytes = bufferBytes * _buffers.size();
+
+    bool huge = false;
+    void* memory = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if (_hugePages)
+    {
+        std::size_t hugeBytes = alignUp(bytes, HUGE_PAGE_SIZE);
+        memory = mmap(NULL, hugeBytes, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (memory != MAP_FAILED)
+        {
+            bytes = hugeBytes;
+            huge = true;
+        }
+        else
+        {
+            LOG(WARNING) << "frame pool huge pages unavailable: "
+                << strerror(errno) << ", fall back to normal pages";
+        }
+    }
+#endif
+    if (memory == MAP_FAILED)
+    {
+        memory = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED)
+        {
+            LOG(ERROR) << "frame pool map " << bytes << " bytes failed: "
+                << strerror(errno);
+            return false;
+        }
+#ifdef MADV_HUGEPAGE
+        if (_hugePages)
+            madvise(memory, bytes, MADV_HUGEPAGE);
+#endif
+    }
+
+    _memory = memory;
+    _mapped = bytes;
+    _size = size;
+    _type = type;
+
+    uint32_t count = _buffers.size();
+    for (uint32_t i = 0; i < count; i++)
+    {
+        auto& buffer = _buffers[i];
+        buffer.data = static_cast<uchar*>(_memory) + i * bufferBytes;
+        buffer.mat = cv::Mat(size, type, buffer.data);
+        _next[i].store(i + 1 < count ? i + 2 : 0);
+    }
+    _head.store(count > 0 ? 1 : 0);
+
+    LOG(INFO) << "frame pool of " << count << " buffers "
+        << size.width << "x" << size.height << ", "
+        << bytes << " bytes" << (huge ? " on huge pages" : "");
+    Metrics::instance().add("framePool.reallocations");
+    Metrics::instance().set("framePool.hugePages", huge ? 1 : 0);
+    return true;
+}
+
+FramePool::Buffer* FramePool::acquire()
+{
+    uint64_t head = _head.load(std::memory_order_acquire);
+    while (true)
+    {
+        uint32_t index = (uint32_t)head;
+        if (index == 0)
+        {
+            if (_memory)
+                Metrics::instance().add(EXHAUSTED);
+            return NULL;
+        }
+
+        uint64_t next = ((head & 0xffffffff00000000ULL) + (1ULL << 32))
+            | _next[index - 1].load(std::memory_order_relaxed);
+        if (_head.compare_exchange_weak(head, next,
+                std::memory_order_acq_rel, std::memory_order_acquire))
+        {
+            _outstanding.fetch_add(1);
+            return &_buffers[index - 1];
+        }
+    }
+}
+
+void FramePool::release(Buffer* buffer)
+{
+    if (!buffer)
+        return;
+
+    // a header moved to the heap by another geometry returns to the pool
+    // memory, the pool is reset before it is used with that geometry
+    if (!owns(buffer))
+        buffer->mat = cv::Mat(_size, _type, buffer->data);
+
+    uint64_t head = _head.load(std::memory_order_relaxed);
+    uint64_t next;
+    do
+    {
+        _next[buffer->index].store((uint32_t)head, std::memory_order_relaxed);
+        next = ((head & 0xffffffff00000000ULL) + (1ULL << 32))
+            | (buffer->index + 1);
+    } while (!_head.compare_exchange_weak(head, next,
+                std::memory_order_release, std::memory_order_relaxed));
+    _outstanding.fetch_sub(1);
+}
+
+}
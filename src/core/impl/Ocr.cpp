@@ -1,20 +1,43 @@
 
 #include <functional>
 #include <limits>
+#include <random>
+#include <cmath>
+#include <cstdlib>
 #include <exception>
 #include <assert.h>
 #include <opencv2/videoio.hpp>
 #include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
 
 #include "3rdparty/easyloggingpp/easylogging++.h"
 #include "core/DataPoint.h"
 #include "core/Ocr.h"
 #include "utils/Common.h"
+#include "utils/Timeline.h"
+#include "utils/Metrics.h"
 
 
+// OpenCV 4.6 takes timeouts and decode threads as open parameters, older
+// versions only get the FFmpeg options from the environment
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 6)
+#define C2MATICA_CAP_OPEN_PARAMS
+#endif
+
 namespace c2matica {
 
+// relative change of the measured in fps that is applied
+static const double FPS_HYSTERESIS = 0.05;
+// longer horizons gather every region
+static const double MAX_GATHER_HORIZON = 3600000; // ms
+// metric names, built once instead of per frame
+static const std::string EVENT_CHANGES = "event.changes";
+static const std::string HEAP_FRAMES = "framePool.heapFrames";
+
 int32_t const Ocr::DEFAULT_RECONNECT_INTERVAL = 1000; // ms
+int32_t const Ocr::DEFAULT_RECONNECT_MAX_INTERVAL = 30000; // ms
+int32_t const Ocr::DEFAULT_OPEN_TIMEOUT = 10000; // ms
+double const Ocr::DEFAULT_RECONNECT_JITTER = 0.2;
 int32_t const Ocr::DEFAULT_UPDATEINFPS_INTERVAL = 1000; //ms
 
 Ocr::Ocr(
@@ -26,12 +49,18 @@ Ocr::Ocr(
     , _streamURL(streamURL)
     , _saveImageDirPath(saveImageDirPath)
     , _cap(NULL)
+    , _frame(NULL)
     , _reconnectInterval(reconnectInterval)
+    , _reconnectAttempts(0)
 {
     if (_reconnectInterval <= 0)
     {
         _reconnectInterval = DEFAULT_RECONNECT_INTERVAL;
     }
+    _reconnectPolicy = { DEFAULT_RECONNECT_MAX_INTERVAL,
+        DEFAULT_OPEN_TIMEOUT,
+        DEFAULT_RECONNECT_JITTER };
+    _captureOptions = { "", 0, 0, false, false, 0, 0, false, false };
 }
 
 Ocr::~Ocr()
@@ -49,28 +78,31 @@ bool Ocr::start()
 
     LOG(INFO) << _streamURL << " ocr started";
 
-    _cap = std::make_shared<cv::VideoCapture>();
     _inFPS = 0;
     _outFPS = 0;
     _frameInterval.store(std::numeric_limits<int>::max());
 
     calcOutFPS();
 
-    if (!waitConnected())
-    {
-        stop();
-        return false;
-    }
-
+    // connecting runs in the background, datapoints start right away and
+    // skip their ticks until the first frame arrives
+    Timeline timeline(_streamURL + " ocr start");
+    _reconnectAttempts = 0;
+    _disconnectedAt = Timer::steady_clock::now();
+    _connectTimer.start(
+        _reconnectInterval,
+        true,
+        std::bind(&Ocr::connect, this, std::placeholders::_1));
     _updateInFPSTimer.start(
         DEFAULT_UPDATEINFPS_INTERVAL,
         false,
         std::bind(&Ocr::updateInFPS, this, std::placeholders::_1));
-    
-    takeAImage();
     _runTimer.run(std::bind(&Ocr::run, this));
+    timeline.mark("startTimers");
 
     onStart();
+    timeline.mark("startDataPoints");
+    timeline.log();
     return true;
 }
 
@@ -83,10 +115,20 @@ void Ocr::stop()
     onStop();
 
     LOG(INFO) << _streamURL << " ocr stoping";
+    _cv.notify_all();
     _connectTimer.stop();
     _updateInFPSTimer.stop();
     _runTimer.stop();
-    _cap->release();
+    // an open still in flight owns its capture and cleans up by itself
+    _pendingOpen.reset();
+    _opened.store(false);
+    putFrame(NULL);
+    if (auto cap = getCap(); cap)
+        cap->release();
+    {
+        std::lock_guard<std::mutex> l(_mutexCap);
+        _cap.reset();
+    }
 
     stopped();
     Stoppable::stop();
@@ -96,66 +138,120 @@ void Ocr::stop()
 bool Ocr::addDataPoint(std::shared_ptr<DataPoint> dataPoint)
 {
     std::lock_guard<std::recursive_mutex> l(_mutexDP);
+    if (!insertDataPoint(dataPoint))
+        return false;
+    updateRegions();
+
+    if (isStart())
+    {
+        calcOutFPS();
+        setFrameInterval();
+    }
+    return true;
+}
+
+bool Ocr::delDataPoint(std::string const& id)
+{
+    std::lock_guard<std::recursive_mutex> l(_mutexDP);
+    if (!eraseDataPoint(id))
+        return false;
+    updateRegions();
+
+    if (isStart())
+    {
+        calcOutFPS();
+        setFrameInterval();
+    }
+    return true;
+}
+
+void Ocr::modDataPoint(std::shared_ptr<DataPoint> newDP)
+{
+    std::lock_guard<std::recursive_mutex> l(_mutexDP);
+    bool intervalChanged = updateDataPoint(newDP);
+    updateRegions();
+    if (intervalChanged && isStart())
+    {
+        calcOutFPS();
+        setFrameInterval();
+    }
+}
+
+void Ocr::applyDataPoints(
+    std::vector<std::shared_ptr<DataPoint>> const& addDPs,
+    std::vector<std::shared_ptr<DataPoint>> const& modDPs,
+    std::vector<std::string> const& delIDs)
+{
+    std::lock_guard<std::recursive_mutex> l(_mutexDP);
+    LOG(INFO) << _streamURL << " apply datapoints add " << addDPs.size()
+        << ", modify " << modDPs.size() << ", delete " << delIDs.size();
+
+    bool intervalChanged = false;
+    for (auto const& id : delIDs)
+        intervalChanged |= eraseDataPoint(id);
+    for (auto const& dp : modDPs)
+        intervalChanged |= updateDataPoint(dp);
+    for (auto const& dp : addDPs)
+        intervalChanged |= insertDataPoint(dp);
+    updateRegions();
+
+    if (intervalChanged && isStart())
+    {
+        calcOutFPS();
+        setFrameInterval();
+    }
+}
+
+bool Ocr::insertDataPoint(std::shared_ptr<DataPoint> dataPoint)
+{
     LOG(INFO) << _streamURL << " add datapoint " << dataPoint->getID();
     if (auto rc = _dpMap.emplace(dataPoint->getID(), dataPoint); rc.second)
     {
+        dataPoint->setFrameSize(_frameSize);
+        dataPoint->setOffset(_roiOffset);
         if (isStart())
         {
-            calcOutFPS();
-            setFrameInterval();
-            if (_opened.load())
-            {
-                dataPoint->start();
-            }
+            dataPoint->start();
         }
         return true;
     }
     return false;
 }
 
-bool Ocr::delDataPoint(std::string const& id)
+bool Ocr::eraseDataPoint(std::string const& id)
 {
-    std::lock_guard<std::recursive_mutex> l(_mutexDP);
     LOG(INFO) << _streamURL << " delete datapoint " << id;
     if (auto iter = _dpMap.find(id); iter != _dpMap.end())
     {
+        // its metrics are erased once the last queued read released it
         _dpMap.erase(iter);
-        if (isStart())
-        {
-            calcOutFPS();
-            setFrameInterval();
-        }
         return true;
     }
 
     return false;
 }
 
-void Ocr::modDataPoint(std::shared_ptr<DataPoint> newDP)
+bool Ocr::updateDataPoint(std::shared_ptr<DataPoint> newDP)
 {
-    std::lock_guard<std::recursive_mutex> l(_mutexDP);
     auto iter = _dpMap.find(newDP->getID());
     if (iter == _dpMap.end())
     {
         LOG(WARNING) << _streamURL << " modify datapoint "
             << newDP->getID() << " not found";
-        return;
+        return false;
     }
 
     auto oldDP = iter->second;
     uint32_t newPollingInterval = newDP->getPollingInterval();
     auto newCoordinate = newDP->getCoordinate();
+    bool intervalChanged = false;
 
     if (oldDP->getPollingInterval() != newPollingInterval)
     {
         LOG(INFO) << _streamURL << " modify datapoint " << oldDP->getID()
             << " polling interval to " << newPollingInterval;
-        if (isStart())
-        {
-            calcOutFPS();
-            setFrameInterval();
-        }
         oldDP->setPollingInterval(newPollingInterval);
+        intervalChanged = true;
     }
 
     if (oldDP->getCoordinate() != newCoordinate)
@@ -168,6 +264,110 @@ void Ocr::modDataPoint(std::shared_ptr<DataPoint> newDP)
             << " height:" << std::get<3>(newCoordinate);
         oldDP->setCoordinate(newCoordinate);
     }
+
+    if (auto newRule = newDP->getRule(); oldDP->getRule() != newRule)
+    {
+        LOG(INFO) << _streamURL << " modify datapoint " << oldDP->getID()
+            << " rule to " << (newRule ? newRule->getIdent() : "none");
+        oldDP->setRule(newRule);
+    }
+
+    if (auto newError = newDP->getRuleError();
+        oldDP->getRuleError() != newError)
+        oldDP->setRuleError(newError);
+
+    if (auto keep = newDP->getKeepOriginalValue();
+        oldDP->getKeepOriginalValue() != keep)
+    {
+        LOG(INFO) << _streamURL << " modify datapoint " << oldDP->getID()
+            << " keep original value to " << (keep ? "true" : "false");
+        oldDP->setKeepOriginalValue(keep);
+    }
+
+    if (auto newMode = newDP->getTriggerMode();
+        oldDP->getTriggerMode() != newMode)
+    {
+        LOG(INFO) << _streamURL << " modify datapoint " << oldDP->getID()
+            << " trigger mode to " << DataPoint::toString(newMode);
+        oldDP->setTriggerMode(newMode);
+    }
+
+    if (auto newGrid = newDP->getGrid(); oldDP->getGrid() != newGrid)
+    {
+        LOG(INFO) << _streamURL << " modify datapoint " << oldDP->getID()
+            << " grid to " << newGrid.rows << "x" << newGrid.cols
+            << " cells of " << newGrid.cellWidth << "x" << newGrid.cellHeight;
+        oldDP->setGrid(newGrid);
+    }
+
+    return intervalChanged;
+}
+
+void Ocr::updateRegions()
+{
+    std::vector<RoiGather::Region> regions;
+    std::unordered_map<std::string, std::weak_ptr<DataPoint>> eventDPs;
+    regions.reserve(_dpMap.size());
+    for (auto const& [id, dp] : _dpMap)
+    {
+        DataPoint::RoiState state;
+        cv::Rect roi = dp->getRoi(&state);
+        // the whole frame is read without a region
+        if (roi.empty() || state == DataPoint::RoiState::INVALID)
+            continue;
+        bool event = dp->getTriggerMode() == DataPoint::TriggerMode::EVENT;
+        regions.push_back({ id, roi, event, dp->getReadDue() });
+        if (event)
+            eventDPs.emplace(id, dp);
+    }
+    _roiGather.setRegions(std::move(regions));
+
+    std::lock_guard<std::mutex> l(_mutexEvent);
+    _eventDPs.swap(eventDPs);
+}
+
+void Ocr::setFrameSize(cv::Size const& size)
+{
+    std::lock_guard<std::recursive_mutex> l(_mutexDP);
+    if (size.empty() || size == _frameSize)
+        return;
+
+    LOG(INFO) << _streamURL << " frame size " << size.width << "x"
+        << size.height << ", validate datapoint regions";
+    _frameSize = size;
+    for (auto const& [id, dp] : _dpMap)
+    {
+        (void)id;
+        dp->setFrameSize(size);
+    }
+    updateRegions();
+}
+
+void Ocr::setRoiOffset(cv::Point const& offset)
+{
+    // the offset is in frame pixels, the regions of a rectified view are
+    // not, it goes into the remap table instead
+    if (_perspective)
+    {
+        LOG(INFO) << _streamURL << " shift the rectified view by x:"
+            << offset.x << " y:" << offset.y << " frame pixels";
+        _roiGather.setFrameOffset(offset);
+        return;
+    }
+
+    std::lock_guard<std::recursive_mutex> l(_mutexDP);
+    if (offset == _roiOffset)
+        return;
+
+    LOG(INFO) << _streamURL << " shift datapoint regions by x:" << offset.x
+        << " y:" << offset.y;
+    _roiOffset = offset;
+    for (auto const& [id, dp] : _dpMap)
+    {
+        (void)id;
+        dp->setOffset(offset);
+    }
+    updateRegions();
 }
 
 std::shared_ptr<DataPoint> Ocr::getDataPoint(std::string const& id)
@@ -180,119 +380,463 @@ std::shared_ptr<DataPoint> Ocr::getDataPoint(std::string const& id)
     return NULL;
 }
 
-bool Ocr::waitConnected()
+void Ocr::setReconnectPolicy(ReconnectPolicy const& policy)
 {
-    LOG(INFO) << _streamURL << " _opened=" << _opened.load();
-    if (_opened.load())
-        return true;
+    _reconnectPolicy = policy;
+    if (_reconnectPolicy.maxInterval < _reconnectInterval)
+        _reconnectPolicy.maxInterval = _reconnectInterval;
+    if (_reconnectPolicy.openTimeout <= 0)
+        _reconnectPolicy.openTimeout = DEFAULT_OPEN_TIMEOUT;
+    if (_reconnectPolicy.jitter < 0 || _reconnectPolicy.jitter >= 1)
+        _reconnectPolicy.jitter = DEFAULT_RECONNECT_JITTER;
+}
 
-    LOG(INFO) << "_reconnectInterval=" << _reconnectInterval;
+void Ocr::setCaptureOptions(CaptureOptions const& options)
+{
+    _captureOptions = options;
+    _framePool.setHugePages(options.hugePages);
+    _roiGather.setGray(options.roiGray);
+
+    // the FFmpeg backend reads its demuxer options from this variable on
+    // every open, as "key;value" pairs separated by '|'
+    std::string ffmpegOptions;
+    auto append = [&ffmpegOptions](char const* key, std::string const& value) {
+        if (!ffmpegOptions.empty())
+            ffmpegOptions.push_back('|');
+        ffmpegOptions.append(key).append(";").append(value);
+    };
+    if (!options.rtspTransport.empty())
+        append("rtsp_transport", options.rtspTransport);
+    if (options.probesize > 0)
+        append("probesize", std::to_string(options.probesize));
+    if (options.analyzeDuration > 0)
+        append("analyzeduration",
+            std::to_string(uint64_t(options.analyzeDuration) * 1000));
+    if (options.noBuffer)
+        append("fflags", "nobuffer");
+    if (options.lowDelay)
+        append("flags", "low_delay");
+    // rtsp socket I/O timeout in us, named stimeout before FFmpeg 5
+    if (options.socketTimeout > 0)
+        append("timeout",
+            std::to_string(uint64_t(options.socketTimeout) * 1000));
+
+    if (ffmpegOptions.empty())
+        return;
 
-    LOG(INFO) << "start connect timer";
-    _connectTimer.start(
-        _reconnectInterval,
-        true,
-        std::bind(&Ocr::connect, this, std::placeholders::_1));
+    if (char const* env = std::getenv("OPENCV_FFMPEG_CAPTURE_OPTIONS"); env)
+        LOG(WARNING) << _streamURL << " OPENCV_FFMPEG_CAPTURE_OPTIONS `"
+            << env << "' overridden by protocolConfig";
+    LOG(INFO) << _streamURL << " ffmpeg capture options " << ffmpegOptions;
+    setenv("OPENCV_FFMPEG_CAPTURE_OPTIONS", ffmpegOptions.c_str(), 1);
 
-    {
-        std::unique_lock<std::mutex> lck(_mutex);
-        _cv.wait(lck, [&]() { return _opened.load() || isStop(); });
-    }
+#ifndef C2MATICA_CAP_OPEN_PARAMS
+    if (options.decodeThreads > 0)
+        LOG(WARNING) << _streamURL << " decodeThreads needs OpenCV 4.6, ignored";
+#endif
+}
 
-    _connectTimer.stop();
-    
-    return _opened.load();
+void Ocr::setHealthPolicy(StreamHealth::Policy const& policy)
+{
+    _health.setPolicy(policy);
+}
+
+void Ocr::setDriftPolicy(DriftTracker::Policy const& policy)
+{
+    _drift.setPolicy(policy);
+}
+
+void Ocr::setPerspective(cv::Matx33d const& homography)
+{
+    _perspective = homography;
+    _roiGather.setPerspective(homography);
+}
+
+std::shared_ptr<cv::VideoCapture> Ocr::getCap()
+{
+    std::lock_guard<std::mutex> l(_mutexCap);
+    return _cap;
 }
 
 void Ocr::connect(Timer::system_time const &tp)
 {
     (void)tp;
-    LOG(INFO) << _streamURL << " connecting...";
+    if (_opened.load())
+        return;
 
-    bool opened = _cap->open(_streamURL, cv::CAP_FFMPEG/*CAP_ANY*/);
-    if (opened && _cap->isOpened())
+    if (!_pendingOpen)
     {
-        LOG(INFO) << _streamURL << " open video stream success";
-        _cap->set(cv::CAP_PROP_BUFFERSIZE, 0);
+        LOG(INFO) << _streamURL << " connecting...";
+        // VideoCapture::open blocks for as long as the backend likes on a
+        // dead camera, run it aside and give up waiting after openTimeout
+        std::vector<int> params;
+#ifdef C2MATICA_CAP_OPEN_PARAMS
+        // let the backend interrupt a hanging open or read by itself
+        params.insert(params.end(),
+            { cv::CAP_PROP_OPEN_TIMEOUT_MSEC, _reconnectPolicy.openTimeout });
+        if (_captureOptions.socketTimeout > 0)
+            params.insert(params.end(), { cv::CAP_PROP_READ_TIMEOUT_MSEC,
+                (int)_captureOptions.socketTimeout });
+        if (_captureOptions.decodeThreads > 0)
+            params.insert(params.end(), { cv::CAP_PROP_N_THREADS,
+                (int)_captureOptions.decodeThreads });
+#endif
+        auto cap = std::make_shared<cv::VideoCapture>();
+        std::packaged_task<bool()> task([cap, url = _streamURL, params]() {
+            auto startTime = Timer::steady_clock::now();
+#ifdef C2MATICA_CAP_OPEN_PARAMS
+            bool opened = cap->open(url, cv::CAP_FFMPEG/*CAP_ANY*/, params);
+#else
+            bool opened = cap->open(url, cv::CAP_FFMPEG/*CAP_ANY*/);
+#endif
+            auto escaped = std::chrono::duration_cast<std::chrono::milliseconds>(
+                Timer::steady_clock::now() - startTime).count();
+            LOG(INFO) << url << " open video stream took " << escaped << "ms";
+            if (opened && cap->isOpened())
+            {
+                Metrics::instance().set("stream.connectMs", escaped);
+                return true;
+            }
+            return false;
+        });
+        _pendingOpen = PendingOpen{ cap, task.get_future().share() };
+        std::thread(std::move(task)).detach();
+    }
+    else
+    {
+        LOG(INFO) << _streamURL << " still connecting...";
+    }
+
+    // wait in slices so that stop() is not held up by a hanging open
+    auto deadline = Timer::steady_clock::now()
+        + std::chrono::milliseconds(_reconnectPolicy.openTimeout);
+    auto& result = _pendingOpen->result;
+    while (result.wait_for(std::chrono::milliseconds(100))
+            != std::future_status::ready)
+    {
+        if (_connectTimer.isStop())
+            return;
+        if (Timer::steady_clock::now() >= deadline)
         {
-            std::lock_guard<std::recursive_mutex> l(_mutexDP);
-            _inFPS = _cap->get(cv::CAP_PROP_FPS);
+            LOG(WARNING) << _streamURL << " open video stream timeout after "
+                << _reconnectPolicy.openTimeout << "ms";
+            scheduleReconnect();
+            return;
         }
-        _opened.store(true);
-        setFrameInterval();
-        _cv.notify_all();
     }
-    else
+
+    bool opened = false;
+    try
+    {
+        opened = result.get();
+    }
+    catch (std::exception& e)
+    {
+        LOG(ERROR) << _streamURL << " open video stream exception: " << e.what();
+    }
+    auto cap = _pendingOpen->cap;
+    _pendingOpen.reset();
+
+    if (!opened)
     {
         LOG(ERROR) << _streamURL << " unable to open video stream";
-        _opened.store(false);
+        scheduleReconnect();
+        return;
+    }
+
+    onConnected(cap);
+}
+
+void Ocr::onConnected(std::shared_ptr<cv::VideoCapture> cap)
+{
+    LOG(INFO) << _streamURL << " open video stream success";
+    cap->set(cv::CAP_PROP_BUFFERSIZE, 0);
+    {
+        std::lock_guard<std::mutex> l(_mutexCap);
+        _cap = cap;
+    }
+    {
+        std::lock_guard<std::recursive_mutex> l(_mutexDP);
+        _inFPS = cap->get(cv::CAP_PROP_FPS);
     }
+    // before run() starts grabbing, takeAImage reads on the same capture
+    std::call_once(_imageOnce, [this]() { takeAImage(); });
+
+    auto recover = std::chrono::duration_cast<std::chrono::milliseconds>(
+        Timer::steady_clock::now() - _disconnectedAt.load()).count();
+    LOG(INFO) << _streamURL << " connected after " << recover << "ms, "
+        << _reconnectAttempts << " failed attempts";
+    Metrics::instance().set("stream.recoverMs", recover);
+    Metrics::instance().set("stream.connected", 1);
+    _reconnectAttempts = 0;
+    _connectTimer.setInterval(_reconnectInterval);
+
+    // the nominal resolution, corrected by the first retrieved frame
+    setFrameSize(cv::Size(cap->get(cv::CAP_PROP_FRAME_WIDTH),
+        cap->get(cv::CAP_PROP_FRAME_HEIGHT)));
+    _health.connected(cap->get(cv::CAP_PROP_FPS));
+    _opened.store(true);
+    setFrameInterval();
+    _cv.notify_all();
+}
+
+void Ocr::onDisconnected()
+{
+    if (!_opened.exchange(false))
+        return;
+
+    LOG(WARNING) << _streamURL << " disconnected, reconnecting";
+    _health.disconnected();
+    putFrame(NULL);
+    _disconnectedAt = Timer::steady_clock::now();
+    Metrics::instance().set("stream.connected", 0);
+    Metrics::instance().add("stream.reconnects");
+}
+
+void Ocr::scheduleReconnect()
+{
+    static thread_local std::mt19937 rng{ std::random_device{}() };
+
+    double delay = std::min<double>(_reconnectPolicy.maxInterval,
+        _reconnectInterval * std::pow(2.0, _reconnectAttempts));
+    std::uniform_real_distribution<double> jitter(
+        1 - _reconnectPolicy.jitter, 1 + _reconnectPolicy.jitter);
+    int interval = std::max<int>(1, std::lround(delay * jitter(rng)));
+    if (delay < _reconnectPolicy.maxInterval)
+        _reconnectAttempts++;
+
+    LOG(INFO) << _streamURL << " reconnect in " << interval << "ms";
+    Metrics::instance().add("stream.connectFailures");
+    _connectTimer.setInterval(interval);
 }
 
 void Ocr::run()
 {
     static int pos = 0;
-    std::vector<int> readyIndex;
-    cv::Mat currentFrame;
 
-    auto onError = [this]() {
-        _opened.store(false);
-        putFrame({});
-        waitConnected();
-    };
-    
+    if (!_opened.load())
+    {
+        std::unique_lock<std::mutex> lck(_mutex);
+        _cv.wait_for(lck, std::chrono::milliseconds(100),
+            [this]() { return _opened.load() || _runTimer.isStop(); });
+        return;
+    }
+
+    auto cap = getCap();
     try
     {
-        if (_cap->grab())
+        if (cap->grab())
         {
+            auto now = Timer::steady_clock::now();
+            auto arrival = Timer::system_clock::now();
+            _health.onGrab(now);
+
+            // frames are retrieved for the datapoints only, the freeze
+            // check of the health monitor hashes some of those
+            bool outDue = (pos++ % getFrameInterval()) == 0;
+            if (!outDue)
+                return;
+            bool healthDue = _health.frameDue(now);
+
 #ifdef DEBUG_LOG
-            if ((pos++ % getFrameInterval()) == 0)
+            auto startTime = Timer::steady_clock::now();
+#endif
+            FramePool::Buffer* buffer = retrieveFrame(*cap);
+            if (!buffer)
+                return;
+#ifdef DEBUG_LOG
+            LOG(DEBUG) << _streamURL << " retrieve frame time escaped "
+                       << std::chrono::duration_cast<std::chrono::milliseconds>(
+                              Timer::steady_clock::now() - startTime)
+                              .count()
+                       << "ms";
+#endif
+            bool reconnect = healthDue &&
+                _health.onFrame(buffer->mat, now) &&
+                _health.getPolicy().reconnectOnFreeze;
+            if (!reconnect)
             {
-                auto startTime = Timer::steady_clock::now();
-                _cap->retrieve(currentFrame);
-                LOG(DEBUG) << _streamURL << " retrieve frame time escaped "
-                           << std::chrono::duration_cast<std::chrono::milliseconds>(
-                                  Timer::steady_clock::now() - startTime)
-                                  .count()
-                           << "ms";
-                putFrame(currentFrame);
+                double pts = cap->get(cv::CAP_PROP_POS_MSEC);
+                // regions move from the next gather on
+                if (_drift.due(now) && _drift.update(buffer->mat, now))
+                    setRoiOffset(_drift.getOffset());
+                auto arena = _roiGather.gather(buffer->mat,
+                    gatherHorizon(now));
+                bool changed = arena && !arena->changed.empty();
+                if (changed)
+                    Metrics::instance().add(EVENT_CHANGES,
+                        arena->changed.size());
+                // the backend reports -1 or NaN when it does not know
+                putFrame(buffer, { pts >= 0 ? pts : -1, arrival }, arena);
+                // after the frame is published, the triggered reads see it
+                if (changed)
+                    triggerEvents(*arena);
+            }
+            else
+            {
+                _framePool.release(buffer);
+            }
+            if (reconnect)
+            {
+                LOG(WARNING) << _streamURL << " reconnect frozen stream";
+                onDisconnected();
             }
-#else
-            if ((pos++ % getFrameInterval()) == 0 &&
-                    _cap->retrieve(currentFrame))
-                putFrame(currentFrame);
-#endif
         }
         else
         {
             LOG(WARNING) << _streamURL << " blank frame grabbed";
-            onError();
+            onDisconnected();
         }
     }
     catch (std::exception& e)
     {
         LOG(ERROR) << _streamURL << " running excetion: " << e.what();
-        onError();
+        onDisconnected();
     }
 }
 
-void Ocr::putFrame(cv::Mat const& frame)
+FramePool::Buffer* Ocr::retrieveFrame(cv::VideoCapture& cap)
 {
-    std::unique_lock<std::shared_mutex> l(_mutexFrame);
-    _frame = frame;
+    FramePool::Buffer* buffer = _framePool.acquire();
+    cv::Mat heapFrame;
+    try
+    {
+        cv::Mat& target = buffer ? buffer->mat : heapFrame;
+        if (!cap.retrieve(target) || target.empty())
+        {
+            LOG(WARNING) << _streamURL << " retrieve frame failed";
+            _health.onDecodeError();
+            _framePool.release(buffer);
+            return NULL;
+        }
+    }
+    catch (...)
+    {
+        _framePool.release(buffer);
+        throw;
+    }
+
+    if (buffer && FramePool::owns(buffer))
+        return buffer;
+
+    // The pool is not sized yet, the stream geometry changed or all
+    // buffers are in use, the frame is allocated on the heap.
+    Metrics::instance().add(HEAP_FRAMES);
+    if (buffer)
+    {
+        heapFrame = buffer->mat;
+        _framePool.release(buffer);
+    }
+    if (!_framePool.fits(heapFrame.size(), heapFrame.type()))
+    {
+        setFrameSize(heapFrame.size());
+        // every buffer must be back before the pool is remapped
+        putFrame(NULL);
+        if (!_framePool.reset(heapFrame.size(), heapFrame.type()))
+            return NULL;
+    }
+    buffer = _framePool.acquire();
+    if (buffer)
+        heapFrame.copyTo(buffer->mat);
+    return buffer;
 }
 
-bool Ocr::getFrame(cv::Mat& frame)
+void Ocr::putFrame(
+    FramePool::Buffer* buffer,
+    FrameInfo const& info,
+    std::shared_ptr<const RoiGather::Arena> arena)
+{
+    FramePool::Buffer* replaced;
+    {
+        std::unique_lock<std::shared_mutex> l(_mutexFrame);
+        replaced = _frame;
+        _frame = buffer;
+        _frameInfo = info;
+        // the replaced arena is recycled once no datapoint holds it
+        _roiArena.swap(arena);
+    }
+    // readers copy under the shared lock, nobody uses it any more
+    _framePool.release(replaced);
+}
+
+bool Ocr::getFrame(cv::Mat& frame, FrameInfo* info)
 {
     std::shared_lock<std::shared_mutex> l(_mutexFrame);
-    if (_frame.empty())
+    if (!_frame)
         return false;
 
     // frame = _frame.clone();
-    _frame.copyTo(frame);
+    _frame->mat.copyTo(frame);
+    if (info)
+        *info = _frameInfo;
     return true;
 }
 
+bool Ocr::getRoi(
+    std::string const& id,
+    cv::Rect const& rect,
+    std::shared_ptr<const RoiGather::Arena>& arena,
+    cv::Mat& view,
+    FrameInfo* info,
+    RoiGather::RegionState* state)
+{
+    std::shared_lock<std::shared_mutex> l(_mutexFrame);
+    if (!_roiArena)
+        return false;
+
+    cv::Mat const* roi = _roiArena->find(id, rect, state);
+    if (!roi)
+        return false;
+
+    arena = _roiArena;
+    view = *roi;
+    if (info)
+        *info = _frameInfo;
+    return true;
+}
+
+bool Ocr::getRoiState(
+    std::string const& id,
+    cv::Rect const& rect,
+    RoiGather::RegionState& state)
+{
+    std::shared_lock<std::shared_mutex> l(_mutexFrame);
+    return _roiArena && _roiArena->find(id, rect, &state);
+}
+
+Timer::steady_time Ocr::gatherHorizon(Timer::steady_time now)
+{
+    // the arena is read until the next one is published, twice that
+    // covers the jitter of the datapoint timers
+    double fps = _health.getMeasuredFPS();
+    if (fps <= 0)
+        return Timer::steady_time::max();
+    // in double, the frame interval of a slow stream overflows an int
+    double ms = 2000.0 * getFrameInterval() / fps;
+    if (!(ms < MAX_GATHER_HORIZON))
+        return Timer::steady_time::max();
+    return now + std::chrono::milliseconds((int64_t)ms);
+}
+
+void Ocr::triggerEvents(RoiGather::Arena const& arena)
+{
+    std::vector<std::pair<std::shared_ptr<DataPoint>, uint64_t>> dps;
+    {
+        std::lock_guard<std::mutex> l(_mutexEvent);
+        for (auto i : arena.changed)
+        {
+            auto iter = _eventDPs.find(arena.layout->regions[i].id);
+            if (iter == _eventDPs.end())
+                continue;
+            if (auto dp = iter->second.lock())
+                dps.emplace_back(std::move(dp), arena.states[i].changes);
+        }
+    }
+    // trigger only queues a job, the capture is not held up by a read
+    for (auto const& [dp, changes] : dps)
+        dp->trigger(changes);
+}
+
 void Ocr::calcOutFPS()
 {
     uint32_t minPollingInterval = std::numeric_limits<std::uint32_t>::max();
@@ -301,16 +845,19 @@ void Ocr::calcOutFPS()
     for (auto const& [id, dp] : _dpMap)
     {
         (void)id;
-        uint32_t dpPollingInterval = dp->getPollingInterval();
+        uint32_t dpPollingInterval = dp->getEffectiveInterval();
         minPollingInterval = minPollingInterval > dpPollingInterval
             ? dpPollingInterval
             : minPollingInterval;
     }
 
-    _outFPS = std::numeric_limits<std::uint32_t>::max() == minPollingInterval
+    double outFPS = std::numeric_limits<std::uint32_t>::max() == minPollingInterval
                   ? 0
                   : (double)1000 / minPollingInterval;
+    if (outFPS == _outFPS)
+        return;
 
+    _outFPS = outFPS;
     LOG(INFO) << _streamURL << " calc out fps " << _outFPS;
 }
 
@@ -320,13 +867,30 @@ void Ocr::updateInFPS(Timer::system_time const &tp)
     if (!_opened.load())
         return;
 
-    double fps = _cap->get(cv::CAP_PROP_FPS);
-    LOG(TRACE) << _streamURL << " in fps " << fps;
+    _health.update(Timer::steady_clock::now());
+    double nominalFPS = getCap()->get(cv::CAP_PROP_FPS);
+    double measuredFPS = _health.getMeasuredFPS();
+    LOG(TRACE) << _streamURL << " in fps nominal " << nominalFPS
+        << ", measured " << measuredFPS;
+    Metrics::instance().set("stream.nominalFPS", nominalFPS);
+    Metrics::instance().set("stream.measuredFPS", measuredFPS);
 
     std::lock_guard<std::recursive_mutex> l(_mutexDP);
-    if (fps == _inFPS)
+    // the nominal rate of the container is often wrong for variable
+    // frame rate cameras, decimate by the measured rate once known and
+    // ignore small changes so that the frame interval does not flap
+    double fps = nominalFPS;
+    if (measuredFPS > 0)
+        fps = _inFPS > 0 &&
+            std::abs(measuredFPS - _inFPS) <= _inFPS * FPS_HYSTERESIS
+            ? _inFPS
+            : measuredFPS;
+    bool outFPSDirty = _outFPSDirty.exchange(false);
+    if (fps == _inFPS && !outFPSDirty)
         return;
 
+    if (outFPSDirty)
+        calcOutFPS();
     _inFPS = fps;
     setFrameInterval();
 }
@@ -345,6 +909,8 @@ void Ocr::setFrameInterval()
         : _inFPS / _outFPS;
     if (0 == interval)
         interval = 1;
+    if (interval == _frameInterval.load())
+        return;
     LOG(INFO) << _streamURL << " in fps " << _inFPS
             << ", out fps " << _outFPS
             << ", out frame interval " << interval;
@@ -359,9 +925,7 @@ int Ocr::getFrameInterval()
 
 bool Ocr::takeAImage()
 {
-    static bool imWrited = false;
-
-    if (_saveImageDirPath.size() <= 0 || imWrited)
+    if (_saveImageDirPath.size() <= 0)
         return true;
 
     std::string now = timeFormatNow();
@@ -376,6 +940,14 @@ bool Ocr::takeAImage()
         {
             if (_cap->read(frame) && !frame.empty())
             {
+                // coordinates are picked on the view they refer to
+                if (_perspective)
+                {
+                    cv::Mat rectified;
+                    cv::warpPerspective(frame, rectified, *_perspective,
+                        frame.size());
+                    frame = rectified;
+                }
                 if (imwrite(filename, frame))
                 {
                     LOG(INFO) << _streamURL << " saved PNG file success";
@@ -404,8 +976,7 @@ bool Ocr::takeAImage()
         LOG(ERROR) << "";
         return false;
     }
-    
-    imWrited = true;
+
     return true;
 }
 
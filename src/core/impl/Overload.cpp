@@ -0,0 +1,116 @@
+#include "3rdparty/easyloggingpp/easylogging++.h"
+#include "core/Overload.h"
+#include "utils/Metrics.h"
+
+namespace c2matica {
+
+const uint32_t Overload::DEFAULT_DEMOTION_TIMEOUT = 3;
+const uint32_t Overload::DEFAULT_DEMOTION_PERIOD = 1000; // s
+const uint32_t Overload::DEFAULT_DEMOTION_FACTOR = 4;
+
+std::atomic<int> Overload::_demotedCount{ 0 };
+
+Overload::Overload(std::string const& id)
+    : _id(id)
+    , _lagMetric("datapoint." + id + ".lagMs")
+    , _droppedMetric("datapoint." + id + ".dropped")
+    , _deadlineMissesMetric("datapoint." + id + ".deadlineMisses")
+    , _demotedMetric("datapoint." + id + ".demoted")
+    , _misses(0)
+{
+    _policy = { DEFAULT_DEMOTION_TIMEOUT,
+        DEFAULT_DEMOTION_PERIOD,
+        DEFAULT_DEMOTION_FACTOR };
+}
+
+Overload::~Overload()
+{
+    // the datapoint metrics were erased with the datapoint, setting
+    // demoted here would bring them back, only the total is kept right
+    if (_demoted.load())
+        Metrics::instance().set("overload.demoted", --_demotedCount);
+}
+
+void Overload::setPolicy(Policy const& policy)
+{
+    std::lock_guard<std::mutex> l(_mutex);
+    _policy = policy;
+    if (_policy.demotionFactor < 1)
+        _policy.demotionFactor = 1;
+}
+
+bool Overload::admit(Timer::steady_time scheduled, uint32_t interval)
+{
+    auto lag = std::chrono::duration_cast<std::chrono::milliseconds>(
+        Timer::steady_clock::now() - scheduled).count();
+    if (lag < 0)
+        lag = 0;
+
+    Metrics::instance().set(_lagMetric, lag);
+    if (lag <= interval)
+        return true;
+
+    Metrics::instance().add(_droppedMetric);
+    LOG(DEBUG) << _id << " drop stale job, lag " << lag << "ms";
+    return false;
+}
+
+void Overload::dropBusy()
+{
+    Metrics::instance().add(_droppedMetric);
+    LOG(DEBUG) << _id << " drop job, previous one still pending";
+}
+
+bool Overload::complete(Timer::steady_time scheduled, uint32_t interval)
+{
+    auto deadline = scheduled + std::chrono::milliseconds(interval);
+    bool missed = Timer::steady_clock::now() > deadline;
+
+    std::lock_guard<std::mutex> l(_mutex);
+    if (!missed)
+    {
+        _misses = 0;
+        return false;
+    }
+
+    Metrics::instance().add(_deadlineMissesMetric);
+    if (_demoted.load() || _policy.demotionTimeout == 0 ||
+        ++_misses < _policy.demotionTimeout)
+        return false;
+
+    _misses = 0;
+    _demotedUntil = Timer::steady_clock::now()
+        + std::chrono::seconds(_policy.demotionPeriod);
+    LOG(WARNING) << _id << " datapoint demoted for "
+        << _policy.demotionPeriod << "s, interval x"
+        << _policy.demotionFactor;
+    setDemoted(true);
+    return true;
+}
+
+bool Overload::checkPromote()
+{
+    if (!_demoted.load())
+        return false;
+
+    std::lock_guard<std::mutex> l(_mutex);
+    if (Timer::steady_clock::now() < _demotedUntil)
+        return false;
+
+    LOG(INFO) << _id << " datapoint promoted";
+    setDemoted(false);
+    return true;
+}
+
+void Overload::setDemoted(bool demoted)
+{
+    _multiplier.store(demoted ? _policy.demotionFactor : 1);
+    if (_demoted.exchange(demoted) == demoted)
+        return;
+
+    int count = demoted ? ++_demotedCount : --_demotedCount;
+    Metrics::instance().set("overload.demoted", count);
+    Metrics::instance().set(_demotedMetric, demoted ? 1 : 0);
+}
+
+}
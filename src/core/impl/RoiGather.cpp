@@ -0,0 +1,308 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <opencv2/imgproc.hpp>
+
+#include "3rdparty/easyloggingpp/easylogging++.h"
+#include "core/RoiGather.h"
+#include "core/Fingerprint.h"
+#include "utils/Metrics.h"
+
+namespace c2matica {
+
+// arenas in flight, the one being filled and those datapoints still read
+static const std::size_t ARENA_COUNT = 3;
+// start of every view, keeps views from sharing cache lines
+static const std::size_t VIEW_ALIGN = 64;
+
+// metric names, built once instead of per frame
+static const std::string ARENA_ALLOCATIONS = "roiGather.arenaAllocations";
+static const std::string GATHER_REGIONS = "roiGather.regions";
+static const std::string GATHER_SKIPPED = "roiGather.skipped";
+static const std::string GATHER_BYTES = "roiGather.bytes";
+static const std::string GATHER_US = "roiGather.gatherUs";
+
+cv::Mat const* RoiGather::Arena::find(
+    std::string const& id,
+    cv::Rect const& rect,
+    RegionState* state) const
+{
+    auto iter = layout->index.find(id);
+    if (iter == layout->index.end() ||
+        layout->regions[iter->second].rect != rect)
+        return NULL;
+
+    cv::Mat const& view = views[iter->second];
+    if (view.empty())
+        return NULL;
+    if (state)
+        *state = states[iter->second];
+    return &view;
+}
+
+const double RoiGather::DEFAULT_CHANGE_DISTANCE = 12.0;
+
+RoiGather::RoiGather()
+    : _layout(std::make_shared<Layout>())
+    , _gray(false)
+    , _changeDistance(DEFAULT_CHANGE_DISTANCE)
+    , _rectify(false)
+{
+}
+
+void RoiGather::setPerspective(cv::Matx33d const& homography)
+{
+    _inverse = homography.inv();
+    _rectify = true;
+    _mapSize = cv::Size();
+}
+
+void RoiGather::setFrameOffset(cv::Point const& offset)
+{
+    if (offset == _frameOffset)
+        return;
+    _frameOffset = offset;
+    _mapSize = cv::Size();
+}
+
+void RoiGather::compileMaps(cv::Size const& size)
+{
+    auto startTime = std::chrono::steady_clock::now();
+
+    cv::Mat mapX(size, CV_32FC1);
+    cv::Mat mapY(size, CV_32FC1);
+    // rectified view to frame, then to where the frame content moved
+    cv::Matx33d shift(1, 0, _frameOffset.x, 0, 1, _frameOffset.y, 0, 0, 1);
+    cv::Matx33d m = shift * _inverse;
+    for (int y = 0; y < size.height; y++)
+    {
+        float* px = mapX.ptr<float>(y);
+        float* py = mapY.ptr<float>(y);
+        // the terms of y are constant along the row
+        double rowX = m(0, 1) * y + m(0, 2);
+        double rowY = m(1, 1) * y + m(1, 2);
+        double rowW = m(2, 1) * y + m(2, 2);
+        for (int x = 0; x < size.width; x++)
+        {
+            double w = m(2, 0) * x + rowW;
+            if (w == 0)
+            {
+                // at infinity, taken from the border
+                px[x] = -1;
+                py[x] = -1;
+                continue;
+            }
+            px[x] = (float)((m(0, 0) * x + rowX) / w);
+            py[x] = (float)((m(1, 0) * x + rowY) / w);
+        }
+    }
+    // fixed point maps remap about twice as fast as float ones
+    cv::convertMaps(mapX, mapY, _map1, _map2, CV_16SC2);
+    _mapSize = size;
+
+    LOG(INFO) << "perspective remap table compiled for " << size.width
+        << "x" << size.height << ", offset x:" << _frameOffset.x
+        << " y:" << _frameOffset.y << " in "
+        << std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now() - startTime).count()
+        << "ms";
+}
+
+void RoiGather::setRegions(std::vector<Region> regions)
+{
+    std::sort(regions.begin(), regions.end(),
+        [](Region const& a, Region const& b) {
+            return a.rect.y != b.rect.y ? a.rect.y < b.rect.y : a.rect.x < b.rect.x;
+        });
+
+    auto layout = std::make_shared<Layout>();
+    layout->regions = std::move(regions);
+    layout->events = false;
+    for (std::size_t i = 0; i < layout->regions.size(); i++)
+    {
+        layout->index.emplace(layout->regions[i].id, i);
+        layout->events |= layout->regions[i].event;
+    }
+
+    std::lock_guard<std::mutex> l(_mutex);
+    _layout = layout;
+}
+
+bool RoiGather::empty()
+{
+    std::lock_guard<std::mutex> l(_mutex);
+    return _layout->regions.empty();
+}
+
+std::shared_ptr<RoiGather::Arena> RoiGather::recycle()
+{
+    for (auto const& arena : _arenas)
+    {
+        if (arena.use_count() == 1)
+        {
+            // pairs with the release of the last reader's reference
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return arena;
+        }
+    }
+
+    // datapoints hold every arena, happens when recognition lags behind
+    // the capture by more than ARENA_COUNT frames
+    Metrics::instance().add(ARENA_ALLOCATIONS);
+    auto arena = std::make_shared<Arena>();
+    if (_arenas.size() < ARENA_COUNT)
+        _arenas.push_back(arena);
+    return arena;
+}
+
+std::shared_ptr<const RoiGather::Arena> RoiGather::gather(
+    cv::Mat const& frame,
+    std::chrono::steady_clock::time_point horizon)
+{
+    std::shared_ptr<const Layout> layout;
+    {
+        std::lock_guard<std::mutex> l(_mutex);
+        layout = _layout;
+    }
+    if (layout->regions.empty() || frame.empty())
+        return NULL;
+
+    auto startTime = std::chrono::steady_clock::now();
+
+    bool gray = _gray && frame.channels() != 1;
+    int type = gray ? CV_8UC1 : frame.type();
+    std::size_t pixelSize = gray ? 1 : frame.elemSize();
+    cv::Rect bounds(0, 0, frame.cols, frame.rows);
+
+    if (_rectify && frame.size() != _mapSize)
+        compileMaps(frame.size());
+
+    auto arena = recycle();
+    arena->layout = layout;
+    arena->views.resize(layout->regions.size());
+    arena->states.assign(layout->regions.size(), RegionState{ 0, 0 });
+    arena->changed.clear();
+
+    // tracked regions are compared on every frame, always gathered
+    bool settling = _settling.load();
+    int64_t until = horizon == std::chrono::steady_clock::time_point::max()
+        ? INT64_MAX : dueOf(horizon);
+    std::size_t selected = 0;
+    _selected.assign(layout->regions.size(), 0);
+    for (std::size_t i = 0; i < layout->regions.size(); i++)
+    {
+        auto const& region = layout->regions[i];
+        _selected[i] = settling || region.event || !region.due ||
+            region.due->load() <= until;
+        selected += _selected[i];
+    }
+
+    // size the arena first, the memory must not move under the views
+    std::size_t bytes = 0;
+    for (std::size_t i = 0; i < layout->regions.size(); i++)
+    {
+        cv::Rect const& rect = layout->regions[i].rect;
+        if (!_selected[i] || rect.empty() || (rect & bounds) != rect)
+            continue;
+        bytes += (std::size_t)rect.area() * pixelSize;
+        bytes = (bytes + VIEW_ALIGN - 1) / VIEW_ALIGN * VIEW_ALIGN;
+    }
+    // over-allocate by one alignment for the start of the first view
+    arena->memory.resize(bytes + VIEW_ALIGN);
+    auto base = reinterpret_cast<std::uintptr_t>(arena->memory.data());
+    uchar* p = arena->memory.data()
+        + ((VIEW_ALIGN - base % VIEW_ALIGN) % VIEW_ALIGN);
+
+    for (std::size_t i = 0; i < layout->regions.size(); i++)
+    {
+        cv::Mat& view = arena->views[i];
+        cv::Rect rect = layout->regions[i].rect;
+        if (!_selected[i] || rect.empty() || (rect & bounds) != rect)
+        {
+            // not read before the next gather, or left for the datapoint
+            // to report
+            view = cv::Mat();
+            continue;
+        }
+
+        view = cv::Mat(rect.size(), type, p);
+        int code = frame.channels() == 4
+            ? cv::COLOR_BGRA2GRAY : cv::COLOR_BGR2GRAY;
+        if (_rectify)
+        {
+            // the table holds the frame position of every rectified pixel
+            cv::remap(frame, gray ? _warped : view, _map1(rect), _map2(rect),
+                cv::INTER_LINEAR, cv::BORDER_CONSTANT);
+            if (gray)
+                cv::cvtColor(_warped, view, code);
+        }
+        else if (gray)
+            cv::cvtColor(frame(rect), view, code);
+        else
+            frame(rect).copyTo(view);
+
+        std::size_t size = (std::size_t)rect.area() * pixelSize;
+        p += (size + VIEW_ALIGN - 1) / VIEW_ALIGN * VIEW_ALIGN;
+    }
+
+    if (settling || layout->events)
+        track(*arena, startTime);
+
+    Metrics::instance().set(GATHER_REGIONS, selected);
+    Metrics::instance().set(GATHER_SKIPPED,
+        layout->regions.size() - selected);
+    Metrics::instance().set(GATHER_BYTES, bytes);
+    Metrics::instance().set(GATHER_US,
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - startTime).count());
+    return arena;
+}
+
+void RoiGather::track(Arena& arena, std::chrono::steady_clock::time_point now)
+{
+    auto const& regions = arena.layout->regions;
+    if (_motionLayout != arena.layout)
+    {
+        // forget regions gone or moved
+        for (auto iter = _motion.begin(); iter != _motion.end(); )
+        {
+            auto index = arena.layout->index.find(iter->first);
+            if (index == arena.layout->index.end() ||
+                regions[index->second].rect != iter->second.rect)
+                iter = _motion.erase(iter);
+            else
+                ++iter;
+        }
+        _motionLayout = arena.layout;
+    }
+
+    bool settling = _settling.load();
+    double changeDistance = _changeDistance.load();
+    for (std::size_t i = 0; i < regions.size(); i++)
+    {
+        if (arena.views[i].empty() || !(settling || regions[i].event))
+            continue;
+
+        fingerprint(arena.views[i], _thumbnail);
+        auto [iter, inserted] = _motion.try_emplace(regions[i].id);
+        Motion& motion = iter->second;
+        if (inserted ||
+            fingerprintDistance(_thumbnail, motion.thumbnail) > changeDistance)
+        {
+            motion.rect = regions[i].rect;
+            motion.stableSince = now;
+            motion.changes++;
+            // the reference of the next frames, a redraw spread over
+            // several of them adds up against it
+            cv::swap(_thumbnail, motion.thumbnail);
+            if (regions[i].event)
+                arena.changed.push_back(i);
+        }
+        arena.states[i].stableMs = std::chrono::duration_cast<
+            std::chrono::milliseconds>(now - motion.stableSince).count();
+        arena.states[i].changes = motion.changes;
+    }
+}
+
+}
@@ -0,0 +1,385 @@
+#include <cmath>
+#include <cctype>
+#include <cstdlib>
+#include <stdexcept>
+
+#include "core/Rule.h"
+
+namespace c2matica {
+
+static const char* const WHITE_SPACES = " \t\r\n";
+
+static std::string trim(std::string const& s)
+{
+    auto begin = s.find_first_not_of(WHITE_SPACES);
+    if (begin == std::string::npos)
+        return "";
+    auto end = s.find_last_not_of(WHITE_SPACES);
+    return s.substr(begin, end - begin + 1);
+}
+
+static std::vector<std::string> split(std::string const& s, char sep)
+{
+    std::vector<std::string> out;
+    std::string::size_type begin = 0;
+    while (true)
+    {
+        auto pos = s.find(sep, begin);
+        out.push_back(s.substr(begin, pos - begin));
+        if (pos == std::string::npos)
+            break;
+        begin = pos + 1;
+    }
+    return out;
+}
+
+// Split s at sep. A separator escaped by a backslash, quoted as 'c' or,
+// with brackets, inside a regex character class [...] does not split.
+// Escapes of sep are resolved, other escapes are kept for the step.
+static std::vector<std::string> splitUnescaped(
+    std::string const& s,
+    char sep,
+    bool brackets = false)
+{
+    std::vector<std::string> out(1);
+    bool inClass = false;
+    for (std::size_t i = 0; i < s.size(); i++)
+    {
+        char c = s[i];
+        if (c == '\\' && i + 1 < s.size())
+        {
+            if (s[i + 1] != sep)
+                out.back().push_back(c);
+            out.back().push_back(s[++i]);
+            continue;
+        }
+        if (c == '\'' && i + 2 < s.size() && s[i + 2] == '\'')
+        {
+            out.back().append(s, i, 3);
+            i += 2;
+            continue;
+        }
+        if (brackets && c == '[')
+            inClass = true;
+        else if (brackets && c == ']')
+            inClass = false;
+        if (c == sep && !inClass)
+            out.emplace_back();
+        else
+            out.back().push_back(c);
+    }
+    return out;
+}
+
+// position of the first sep not escaped or quoted, npos if none
+static std::size_t findUnescaped(std::string const& s, char sep)
+{
+    for (std::size_t i = 0; i < s.size(); i++)
+    {
+        if (s[i] == '\\')
+            i++;
+        else if (s[i] == '\'' && i + 2 < s.size() && s[i + 2] == '\'')
+            i += 2;
+        else if (s[i] == sep)
+            return i;
+    }
+    return std::string::npos;
+}
+
+// resolve 'c' quoting of a whole operand and backslash escapes
+static std::string unescape(std::string const& s)
+{
+    if (s.size() == 3 && s.front() == '\'' && s.back() == '\'')
+        return s.substr(1, 1);
+    std::string out;
+    out.reserve(s.size());
+    for (std::size_t i = 0; i < s.size(); i++)
+    {
+        if (s[i] == '\\' && i + 1 < s.size())
+            i++;
+        out.push_back(s[i]);
+    }
+    return out;
+}
+
+// replace $1..$9 by args and $$ by $
+static std::string substitute(
+    std::string const& s,
+    std::vector<std::string> const& args)
+{
+    std::string out;
+    out.reserve(s.size());
+    for (std::size_t i = 0; i < s.size(); i++)
+    {
+        if (s[i] != '$' || i + 1 == s.size())
+        {
+            out.push_back(s[i]);
+            continue;
+        }
+        char next = s[i + 1];
+        if (next == '$')
+        {
+            out.push_back('$');
+            i++;
+        }
+        else if (next >= '1' && next <= '9')
+        {
+            std::size_t n = next - '1';
+            if (n >= args.size())
+                throw std::invalid_argument(
+                    "rule argument $" + std::string(1, next) + " not given");
+            out.append(args[n]);
+            i++;
+        }
+        else
+        {
+            out.push_back('$');
+        }
+    }
+    return out;
+}
+
+static bool parseDouble(std::string const& s, double& out)
+{
+    std::string t = trim(s);
+    if (t.empty())
+        return false;
+
+    char* end = NULL;
+    out = std::strtod(t.c_str(), &end);
+    return end == t.c_str() + t.size() && std::isfinite(out);
+}
+
+Rule::Rule(
+    std::string ident,
+    std::string content,
+    std::string args,
+    std::string unit)
+    : _ident(ident)
+    , _unit(unit)
+{
+    compile(content, args);
+}
+
+std::string Rule::cacheKey(
+    std::string const& ident,
+    std::string const& content,
+    std::string const& args,
+    std::string const& unit)
+{
+    std::string key;
+    key.reserve(ident.size() + content.size() + args.size() + unit.size() + 3);
+    key.append(ident).push_back('\0');
+    key.append(content).push_back('\0');
+    key.append(args).push_back('\0');
+    key.append(unit);
+    return key;
+}
+
+void Rule::compile(std::string const& content, std::string const& args)
+{
+    std::vector<std::string> vArgs;
+    if (!trim(args).empty())
+    {
+        for (auto const& arg : splitUnescaped(args, ','))
+            vArgs.push_back(trim(arg));
+    }
+
+    for (auto const& stepSource : splitUnescaped(content, ';', true))
+    {
+        if (trim(stepSource).empty())
+            continue;
+
+        std::string name = stepSource;
+        std::string arg;
+        if (auto pos = stepSource.find(':'); pos != std::string::npos)
+        {
+            name = stepSource.substr(0, pos);
+            arg = stepSource.substr(pos + 1);
+        }
+        name = trim(name);
+        // a pattern is taken as written, $ is an anchor there
+        if (name != "regex")
+            arg = substitute(arg, vArgs);
+
+        Step step;
+        step.a = 1;
+        step.b = 0;
+        step.map.fill(-2);
+
+        if (name == "trim")
+        {
+            step.op = Op::Trim;
+        }
+        else if (name == "regex")
+        {
+            step.op = Op::Regex;
+            step.regex = std::regex(arg,
+                std::regex::ECMAScript | std::regex::optimize);
+        }
+        else if (name == "map")
+        {
+            step.op = Op::Map;
+            for (auto const& pair : splitUnescaped(arg, ','))
+            {
+                auto pos = findUnescaped(pair, '=');
+                // quoted or escaped, e.g. ' '= or '='=- or \,=.
+                std::string from = unescape(trim(pair.substr(0, pos)));
+                std::string to = pos == std::string::npos
+                    ? "" : unescape(trim(pair.substr(pos + 1)));
+                if (from.size() != 1 || to.size() > 1)
+                    throw std::invalid_argument(
+                        "rule map expects single byte pairs, got `" + pair + "'");
+                step.map[(unsigned char)from[0]] = to.empty()
+                    ? -1 : (unsigned char)to[0];
+            }
+        }
+        else if (name == "number")
+        {
+            step.op = Op::Number;
+            auto params = split(arg, ',');
+            if (!trim(arg).empty() && !parseDouble(params[0], step.a))
+                throw std::invalid_argument("rule number bad scale `" + arg + "'");
+            if (params.size() > 1 && !parseDouble(params[1], step.b))
+                throw std::invalid_argument("rule number bad offset `" + arg + "'");
+        }
+        else if (name == "bool")
+        {
+            step.op = Op::Bool;
+        }
+        else if (name == "clamp")
+        {
+            step.op = Op::Clamp;
+            auto params = split(arg, ',');
+            if (params.size() != 2 ||
+                !parseDouble(params[0], step.a) ||
+                !parseDouble(params[1], step.b) ||
+                step.a > step.b)
+                throw std::invalid_argument("rule clamp bad range `" + arg + "'");
+        }
+        else if (name == "unit")
+        {
+            step.op = Op::Unit;
+            step.text = trim(arg);
+        }
+        else
+        {
+            throw std::invalid_argument("unknown rule step `" + name + "'");
+        }
+
+        _steps.push_back(std::move(step));
+    }
+}
+
+Rule::Result Rule::apply(std::string const& text) const
+{
+    Result result{ true, text, _unit, "" };
+
+    auto fail = [&result](std::string error) -> Result& {
+        result.ok = false;
+        result.value = std::monostate{};
+        result.error = std::move(error);
+        return result;
+    };
+
+    for (auto const& step : _steps)
+    {
+        switch (step.op)
+        {
+            case Op::Trim:
+            case Op::Regex:
+            case Op::Map:
+            case Op::Number:
+            case Op::Bool:
+                if (!std::holds_alternative<std::string>(result.value))
+                    return fail("text step after typed value");
+                break;
+            case Op::Clamp:
+                if (!std::holds_alternative<double>(result.value))
+                    return fail("clamp on non number value");
+                break;
+            case Op::Unit:
+                break;
+        }
+
+        switch (step.op)
+        {
+            case Op::Trim:
+            {
+                auto& s = std::get<std::string>(result.value);
+                s = trim(s);
+                break;
+            }
+            case Op::Regex:
+            {
+                auto& s = std::get<std::string>(result.value);
+                std::smatch m;
+                if (!std::regex_search(s, m, step.regex))
+                    return fail("regex not matched");
+                s = m.size() > 1 ? m[1].str() : m[0].str();
+                break;
+            }
+            case Op::Map:
+            {
+                auto& s = std::get<std::string>(result.value);
+                std::string mapped;
+                mapped.reserve(s.size());
+                for (unsigned char c : s)
+                {
+                    int16_t to = step.map[c];
+                    if (to == -2)
+                        mapped.push_back(c);
+                    else if (to >= 0)
+                        mapped.push_back((char)to);
+                }
+                s = std::move(mapped);
+                break;
+            }
+            case Op::Number:
+            {
+                double v;
+                if (!parseDouble(std::get<std::string>(result.value), v))
+                    return fail("not a number");
+                result.value = v * step.a + step.b;
+                break;
+            }
+            case Op::Bool:
+            {
+                std::string s = trim(std::get<std::string>(result.value));
+                for (auto& c : s)
+                    c = std::tolower((unsigned char)c);
+                if (s == "1" || s == "true" || s == "on" || s == "yes")
+                    result.value = true;
+                else if (s == "0" || s == "false" || s == "off" || s == "no")
+                    result.value = false;
+                else
+                    return fail("not a bool");
+                break;
+            }
+            case Op::Clamp:
+            {
+                double v = std::get<double>(result.value);
+                result.value = v < step.a ? step.a : (v > step.b ? step.b : v);
+                break;
+            }
+            case Op::Unit:
+                result.unit = step.text;
+                break;
+        }
+    }
+
+    return result;
+}
+
+// -----------------------------------------------------------------------
+
+std::shared_ptr<const Rule> makeRule(
+    std::string ident,
+    std::string content,
+    std::string args,
+    std::string unit)
+{
+    return std::make_shared<const Rule>(ident, content, args, unit);
+}
+
+}
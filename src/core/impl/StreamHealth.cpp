@@ -0,0 +1,213 @@
+#include <array>
+#include <algorithm>
+#include <cstring>
+
+#include "3rdparty/easyloggingpp/easylogging++.h"
+#include "core/StreamHealth.h"
+#include "utils/Common.h"
+#include "utils/Metrics.h"
+
+namespace c2matica {
+
+const uint32_t StreamHealth::DEFAULT_FREEZE_TIMEOUT = 60000; // ms
+const uint32_t StreamHealth::HASH_INTERVAL = 1000; // ms
+
+// sampled grid of the frame hash
+static const int HASH_COLS = 64;
+static const int HASH_ROWS = 48;
+// weight of the newest inter-frame interval
+static const double EWMA_ALPHA = 0.1;
+// grabs before the measured rate is trusted, about 1/alpha
+static const uint32_t MIN_SAMPLES = 10;
+// slower than nominal by this factor is degraded
+static const double SLOW_FACTOR = 2.0;
+// no frame for this long is degraded
+static const int64_t STALL_TIMEOUT = 2000; // ms
+// metric name, built once instead of per frame
+static const std::string FRAME_INTERVAL_MS = "stream.frameIntervalMs";
+
+static double elapsedMs(Timer::steady_time from, Timer::steady_time to)
+{
+    return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+// Hash a sparse grid of full resolution pixels, any change of a sampled
+// pixel changes the hash while no per pixel pass over the frame is made.
+static uint64_t sampleHash(cv::Mat const& frame)
+{
+    std::array<uchar, HASH_COLS * HASH_ROWS * 4> samples;
+    std::size_t pixelSize = std::min<std::size_t>(frame.elemSize(), 4);
+    int rows = std::min(frame.rows, HASH_ROWS);
+    int cols = std::min(frame.cols, HASH_COLS);
+    std::size_t n = 0;
+    for (int r = 0; r < rows; r++)
+    {
+        uchar const* row = frame.ptr(r * frame.rows / rows);
+        for (int c = 0; c < cols; c++)
+        {
+            std::memcpy(&samples[n],
+                row + (c * frame.cols / cols) * frame.elemSize(), pixelSize);
+            n += pixelSize;
+        }
+    }
+    return hash64(samples.data(), n);
+}
+
+StreamHealth::StreamHealth()
+    : _nominalInterval(0)
+    , _intervalEwma(0)
+    , _samples(0)
+    , _frameHash(0)
+    , _decodeErrors(0)
+{
+    _policy = { DEFAULT_FREEZE_TIMEOUT, false };
+}
+
+void StreamHealth::setPolicy(Policy const& policy)
+{
+    std::lock_guard<std::mutex> l(_mutex);
+    _policy = policy;
+}
+
+StreamHealth::Policy StreamHealth::getPolicy()
+{
+    std::lock_guard<std::mutex> l(_mutex);
+    return _policy;
+}
+
+void StreamHealth::connected(double nominalFPS)
+{
+    std::lock_guard<std::mutex> l(_mutex);
+    auto now = Timer::steady_clock::now();
+    _nominalInterval = nominalFPS > 0 ? 1000 / nominalFPS : 0;
+    _intervalEwma = 0;
+    _samples = 0;
+    _lastGrab = now;
+    _lastHash = Timer::steady_time();
+    _unchangedSince = now;
+    _frameHash = 0;
+    _decodeErrors = 0;
+    setState(State::HEALTHY);
+}
+
+void StreamHealth::disconnected()
+{
+    std::lock_guard<std::mutex> l(_mutex);
+    setState(State::DISCONNECTED);
+}
+
+void StreamHealth::onGrab(Timer::steady_time now)
+{
+    std::lock_guard<std::mutex> l(_mutex);
+    double interval = elapsedMs(_lastGrab, now);
+    _intervalEwma = _intervalEwma == 0
+        ? interval
+        : _intervalEwma + EWMA_ALPHA * (interval - _intervalEwma);
+    _lastGrab = now;
+    _samples++;
+}
+
+double StreamHealth::getMeasuredFPS()
+{
+    std::lock_guard<std::mutex> l(_mutex);
+    if (_samples < MIN_SAMPLES || _intervalEwma <= 0)
+        return 0;
+    return 1000 / _intervalEwma;
+}
+
+void StreamHealth::onDecodeError()
+{
+    std::lock_guard<std::mutex> l(_mutex);
+    _decodeErrors++;
+    Metrics::instance().add("stream.decodeErrors");
+}
+
+bool StreamHealth::frameDue(Timer::steady_time now)
+{
+    std::lock_guard<std::mutex> l(_mutex);
+    return _policy.freezeTimeout > 0 &&
+        elapsedMs(_lastHash, now) >= HASH_INTERVAL;
+}
+
+bool StreamHealth::onFrame(cv::Mat const& frame, Timer::steady_time now)
+{
+    if (frame.empty())
+        return false;
+
+    uint64_t hash = sampleHash(frame);
+
+    std::lock_guard<std::mutex> l(_mutex);
+    _lastHash = now;
+    if (hash != _frameHash)
+    {
+        _frameHash = hash;
+        _unchangedSince = now;
+        if (_state.load() == State::FROZEN)
+        {
+            LOG(INFO) << "stream unfrozen";
+            setState(State::HEALTHY);
+        }
+        return false;
+    }
+
+    if (_policy.freezeTimeout == 0 || _state.load() == State::FROZEN ||
+        elapsedMs(_unchangedSince, now) < _policy.freezeTimeout)
+        return false;
+
+    LOG(WARNING) << "stream frozen, frame unchanged for "
+        << (int64_t)elapsedMs(_unchangedSince, now) << "ms";
+    Metrics::instance().add("stream.freezes");
+    setState(State::FROZEN);
+    return true;
+}
+
+StreamHealth::State StreamHealth::update(Timer::steady_time now)
+{
+    std::lock_guard<std::mutex> l(_mutex);
+    State state = _state.load();
+    if (state == State::HEALTHY || state == State::DEGRADED)
+    {
+        bool stalled = elapsedMs(_lastGrab, now) > std::max<double>(
+            STALL_TIMEOUT, _nominalInterval * 4);
+        bool slow = _nominalInterval > 0 &&
+            _intervalEwma > _nominalInterval * SLOW_FACTOR;
+        bool degraded = stalled || slow || _decodeErrors > 0;
+        if (degraded && state == State::HEALTHY)
+            LOG(WARNING) << "stream degraded,"
+                << " frame interval " << _intervalEwma << "ms"
+                << " nominal " << _nominalInterval << "ms"
+                << ", decode errors " << _decodeErrors
+                << (stalled ? ", stalled" : "");
+        else if (!degraded && state == State::DEGRADED)
+            LOG(INFO) << "stream healthy again";
+        setState(degraded ? State::DEGRADED : State::HEALTHY);
+    }
+    _decodeErrors = 0;
+
+    Metrics::instance().set(FRAME_INTERVAL_MS, _intervalEwma);
+    return _state.load();
+}
+
+void StreamHealth::setState(State state)
+{
+    _state.store(state);
+    Metrics::instance().set("stream.health", (double)state);
+}
+
+char const* StreamHealth::toString(State state)
+{
+    switch (state)
+    {
+        case State::DISCONNECTED:
+            return "disconnected";
+        case State::HEALTHY:
+            return "healthy";
+        case State::DEGRADED:
+            return "degraded";
+        case State::FROZEN:
+            return "frozen";
+    }
+    return "unknown";
+}
+
+}
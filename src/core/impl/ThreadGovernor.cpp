@@ -0,0 +1,102 @@
+#include <cstdlib>
+#include <algorithm>
+#include <opencv2/core.hpp>
+
+#include "3rdparty/easyloggingpp/easylogging++.h"
+#include "core/ThreadGovernor.h"
+#include "utils/Metrics.h"
+
+namespace c2matica {
+
+bool parseParallelism(std::string const& s, Parallelism& out)
+{
+    if (s == "auto")
+        out = Parallelism::AUTO;
+    else if (s == "inter")
+        out = Parallelism::INTER;
+    else if (s == "intra")
+        out = Parallelism::INTRA;
+    else
+        return false;
+    return true;
+}
+
+char const* toString(Parallelism parallelism)
+{
+    switch (parallelism)
+    {
+        case Parallelism::AUTO:
+            return "auto";
+        case Parallelism::INTER:
+            return "inter";
+        case Parallelism::INTRA:
+            return "intra";
+    }
+    return "unknown";
+}
+
+ThreadPlan planThreads(
+    Parallelism parallelism,
+    int cpus,
+    std::size_t datapoints,
+    double meanRoiArea,
+    std::size_t workers)
+{
+    if (cpus <= 0)
+        cpus = 1;
+
+    if (parallelism == Parallelism::AUTO)
+    {
+        parallelism = datapoints * 2 < (std::size_t)cpus &&
+                meanRoiArea >= INTRA_MIN_ROI_AREA
+            ? Parallelism::INTRA
+            : Parallelism::INTER;
+    }
+
+    ThreadPlan plan;
+    plan.parallelism = parallelism;
+    if (parallelism == Parallelism::INTER)
+    {
+        plan.workers = workers > 0 ? workers : cpus;
+        plan.ompThreads = 1;
+        plan.cvThreads = 1;
+    }
+    else
+    {
+        // keep at least two threads per team
+        std::size_t maxWorkers = std::max(1, cpus / 2);
+        plan.workers = workers > 0
+            ? workers
+            : std::clamp<std::size_t>(datapoints, 1, maxWorkers);
+        plan.ompThreads = std::max<int>(1, cpus / plan.workers);
+        plan.cvThreads = plan.ompThreads;
+    }
+
+    return plan;
+}
+
+void applyThreadPlan(ThreadPlan const& plan)
+{
+    cv::setNumThreads(plan.cvThreads);
+
+    LOG(INFO) << "thread plan " << toString(plan.parallelism)
+        << ": workers " << plan.workers
+        << ", omp threads " << plan.ompThreads
+        << ", opencv threads " << plan.cvThreads;
+
+#ifdef _OPENMP
+    // a num_threads clause inside a library overrides the per thread ICV,
+    // only OMP_THREAD_LIMIT given before start bounds it
+    if (plan.ompThreads == 1 && !std::getenv("OMP_THREAD_LIMIT"))
+    {
+        LOG(INFO) << "OMP_THREAD_LIMIT not set, export OMP_THREAD_LIMIT=1 "
+            << "to also bound explicit OpenMP teams";
+    }
+#endif
+
+    Metrics::instance().set("threads.workers", plan.workers);
+    Metrics::instance().set("threads.omp", plan.ompThreads);
+    Metrics::instance().set("threads.opencv", plan.cvThreads);
+}
+
+}
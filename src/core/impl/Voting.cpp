@@ -0,0 +1,50 @@
+#include <algorithm>
+
+#include "core/Voting.h"
+
+namespace c2matica {
+
+Voting::Voting()
+{
+    _policy = { 0, 0, false };
+}
+
+void Voting::setPolicy(Policy const& policy)
+{
+    _policy = policy;
+    _policy.quorum = std::clamp<uint32_t>(_policy.quorum, 1,
+        std::max<uint32_t>(_policy.window, 1));
+    _reads.clear();
+}
+
+bool Voting::vote(std::string const& text, int confidence,
+    std::string& value, double& support)
+{
+    double weight = _policy.weighted
+        ? std::clamp(confidence, 0, 100) / 100.0
+        : 1.0;
+    _reads.emplace_back(text, weight);
+    while (_reads.size() > _policy.window)
+        _reads.pop_front();
+
+    // the window is small, a quadratic count beats a map
+    support = 0;
+    for (std::size_t i = 0; i < _reads.size(); i++)
+    {
+        double sum = 0;
+        for (std::size_t j = 0; j < _reads.size(); j++)
+        {
+            if (_reads[j].first == _reads[i].first)
+                sum += _reads[j].second;
+        }
+        // prefer the newest value on ties
+        if (sum >= support)
+        {
+            support = sum;
+            value = _reads[i].first;
+        }
+    }
+    return support >= _policy.quorum;
+}
+
+}
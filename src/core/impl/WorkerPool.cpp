@@ -0,0 +1,237 @@
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <iterator>
+
+#include "3rdparty/easyloggingpp/easylogging++.h"
+#include "core/WorkerPool.h"
+#include "utils/Common.h"
+#include "utils/Metrics.h"
+
+namespace c2matica {
+
+// utilization of each worker is reported once per window
+static const auto METRICS_WINDOW = std::chrono::seconds(1);
+
+WorkerPool::WorkerPool(std::size_t workers, int ompThreads)
+    : _ompThreads(ompThreads > 0 ? ompThreads : 1)
+{
+    createWorkers(workers);
+}
+
+WorkerPool::~WorkerPool()
+{
+    stop();
+}
+
+void WorkerPool::createWorkers(std::size_t workers)
+{
+    if (workers == 0)
+    {
+        int cpus = availableCpus();
+        workers = cpus / _ompThreads;
+        if (workers == 0)
+            workers = 1;
+        LOG(INFO) << "worker pool sized " << workers << " from "
+            << cpus << " cpus, " << _ompThreads << " omp threads per job";
+    }
+
+    _workers.clear();
+    for (std::size_t i = 0; i < workers; i++)
+        _workers.push_back(std::make_unique<Worker>());
+}
+
+bool WorkerPool::start()
+{
+    if (_running.exchange(true))
+        return false;
+
+    for (std::size_t i = 0; i < _workers.size(); i++)
+    {
+        _workers[i]->windowStart = Timer::steady_clock::now();
+        _workers[i]->thread = std::thread(&WorkerPool::loop, this, i);
+    }
+
+    LOG(INFO) << "worker pool started " << _workers.size() << " workers";
+    return true;
+}
+
+void WorkerPool::join()
+{
+    {
+        std::lock_guard<std::mutex> l(_mutex);
+        _cv.notify_all();
+    }
+
+    for (auto& worker : _workers)
+    {
+        if (worker->thread.joinable())
+            worker->thread.join();
+    }
+}
+
+void WorkerPool::stop()
+{
+    if (!_running.exchange(false))
+        return;
+
+    join();
+    for (auto& worker : _workers)
+    {
+        std::deque<Task> jobs;
+        {
+            std::lock_guard<std::mutex> l(worker->mutex);
+            jobs.swap(worker->jobs);
+        }
+        _pending -= (long)jobs.size();
+        // outside the lock, a dropped job may submit again
+        for (auto& task : jobs)
+        {
+            if (task.dropped)
+                task.dropped();
+        }
+    }
+
+    LOG(INFO) << "worker pool stopped";
+}
+
+void WorkerPool::resize(std::size_t workers, int ompThreads)
+{
+    bool running = _running.exchange(false);
+    if (running)
+        join();
+
+    {
+        std::unique_lock<std::shared_mutex> l(_workersMutex);
+        std::deque<Task> jobs;
+        for (auto& worker : _workers)
+        {
+            std::move(worker->jobs.begin(), worker->jobs.end(),
+                std::back_inserter(jobs));
+        }
+
+        _ompThreads = ompThreads > 0 ? ompThreads : 1;
+        createWorkers(workers);
+        for (std::size_t i = 0; i < jobs.size(); i++)
+            _workers[i % _workers.size()]->jobs.push_back(std::move(jobs[i]));
+    }
+
+    // workers no longer there report no utilization
+    Metrics::instance().erase("pool.worker");
+    LOG(INFO) << "worker pool resized to " << _workers.size() << " workers, "
+        << _ompThreads << " omp threads per job";
+    if (running)
+        start();
+}
+
+void WorkerPool::submit(Job job, Job dropped)
+{
+    {
+        std::shared_lock<std::shared_mutex> lw(_workersMutex);
+        std::size_t index = _next++ % _workers.size();
+        std::lock_guard<std::mutex> l(_workers[index]->mutex);
+        _workers[index]->jobs.push_back({ std::move(job), std::move(dropped) });
+    }
+
+    {
+        std::lock_guard<std::mutex> l(_mutex);
+        _pending++;
+    }
+    _cv.notify_one();
+}
+
+bool WorkerPool::take(std::size_t index, Task& task)
+{
+    {
+        auto& worker = *_workers[index];
+        std::lock_guard<std::mutex> l(worker.mutex);
+        if (!worker.jobs.empty())
+        {
+            task = std::move(worker.jobs.front());
+            worker.jobs.pop_front();
+            return true;
+        }
+    }
+
+    // steal from the back of the others
+    for (std::size_t i = 1; i < _workers.size(); i++)
+    {
+        auto& victim = *_workers[(index + i) % _workers.size()];
+        std::lock_guard<std::mutex> l(victim.mutex);
+        if (!victim.jobs.empty())
+        {
+            task = std::move(victim.jobs.back());
+            victim.jobs.pop_back();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void WorkerPool::loop(std::size_t index)
+{
+#ifdef _OPENMP
+    // per thread ICV, bounds the teams of Tesseract and OpenCV regions
+    omp_set_num_threads(_ompThreads);
+#endif
+
+    auto& worker = *_workers[index];
+    while (_running.load())
+    {
+        Task task;
+        if (take(index, task))
+        {
+            _pending--;
+            auto startTime = Timer::steady_clock::now();
+            try
+            {
+                task.job();
+            }
+            catch (std::exception& e)
+            {
+                LOG(ERROR) << "worker " << index << " job exception: "
+                    << e.what();
+            }
+            worker.busy += Timer::steady_clock::now() - startTime;
+            Metrics::instance().add("pool.jobs");
+        }
+        else
+        {
+            std::unique_lock<std::mutex> l(_mutex);
+            _cv.wait_for(l, METRICS_WINDOW, [this]() {
+                return _pending.load() > 0 || !_running.load();
+            });
+        }
+
+        updateMetrics(index);
+    }
+}
+
+void WorkerPool::updateMetrics(std::size_t index)
+{
+    auto& worker = *_workers[index];
+    auto now = Timer::steady_clock::now();
+    auto elapsed = now - worker.windowStart;
+    if (elapsed < METRICS_WINDOW)
+        return;
+
+    double utilization = (double)worker.busy.count() / elapsed.count();
+    Metrics::instance().set(
+        "pool.worker" + std::to_string(index) + ".utilization", utilization);
+    Metrics::instance().set("pool.pending", _pending.load());
+    worker.busy = Timer::steady_clock::duration::zero();
+    worker.windowStart = now;
+}
+
+// -----------------------------------------------------------------------
+
+std::unique_ptr<WorkerPool> makeWorkerPool(
+    std::size_t workers,
+    int ompThreads)
+{
+    return std::make_unique<WorkerPool>(workers, ompThreads);
+}
+
+}
@@ -1,10 +1,14 @@
 
 #include <string>
+#include <string_view>
 #include <mutex>
+#include <unordered_map>
 
 #include "3rdparty/easyloggingpp/easylogging++.h"
 #include "core/DataPoint.h"
 #include "main/Application.h"
+#include "utils/Metrics.h"
+#include "utils/Common.h"
 
 // using namespace std::string_literals;
 
@@ -12,6 +16,7 @@ namespace c2matica {
 
 Application::Application(std::unique_ptr<Config> config)
     : _config(std::move(config))
+    , _startupTimeline("startup")
 {
     _checkDPConfigFileInterval = DEFAULT_CHECK_DP_CONFIG_FILE_INTERVAL;
 }
@@ -58,11 +63,46 @@ void Application::initLog()
 
 bool Application::loadConfig()
 {
-    return _config->load();
+    bool ok = _config->load();
+    _startupTimeline.mark("loadConfig");
+    return ok;
+}
+
+ThreadPlan Application::planThreads() const
+{
+    double roiArea = 0;
+    std::size_t sized = 0;
+    for (auto const& dpConfig : _config->vDataPointConfig)
+    {
+        // the whole frame, its size is not known before the stream opens
+        if (dpConfig.coordinateDetail.width == 0 ||
+            dpConfig.coordinateDetail.height == 0)
+            continue;
+        roiArea += (double)dpConfig.coordinateDetail.width
+            * dpConfig.coordinateDetail.height;
+        sized++;
+    }
+    std::size_t datapoints = _config->vDataPointConfig.size();
+    if (sized < datapoints)
+    {
+        LOG(INFO) << "thread plan: " << datapoints - sized
+            << " whole frame datapoints left out of the mean roi area";
+    }
+    return c2matica::planThreads(
+        _config->mProtocolConfig.parallelism,
+        availableCpus(),
+        datapoints,
+        sized > 0 ? roiArea / sized : 0,
+        _config->mProtocolConfig.workerThreads);
 }
 
 void Application::setup()
 {
+    ThreadPlan plan = planThreads();
+    applyThreadPlan(plan);
+
+    _workerPool = std::move(makeWorkerPool(plan.workers, plan.ompThreads));
+
     _ocr = std::move(makeOcr(
         NULL,
         _config->mProtocolConfig.streamURL,
@@ -70,39 +110,51 @@ void Application::setup()
             ? _config->basePath
             : "",
         _config->RECONNECT_INTERVAL));
+    _ocr->setReconnectPolicy(_config->mProtocolConfig.reconnect);
+    _ocr->setCaptureOptions(_config->mProtocolConfig.capture);
+    _ocr->setHealthPolicy(_config->mProtocolConfig.health);
+    _ocr->setDriftPolicy(_config->mProtocolConfig.drift);
+    if (auto const& perspective = _config->mProtocolConfig.perspective)
+        _ocr->setPerspective(*perspective);
+    _ocr->setSettling(_config->mProtocolConfig.settle.settleTime > 0);
+    // a region settles or triggers its event by the adaptive threshold
+    _ocr->setChangeDistance(
+        _config->mProtocolConfig.adaptivePolling.stableDistance);
 
     for (auto const& dpConfig : _config->vDataPointConfig)
     {
-        std::shared_ptr<DataPoint> dp = 
-            makeDataPoint(
-                _ocr.get(),
-                dpConfig.dpId,
-                _config->tessdataPath,
-                _config->LANGUAGE,
-                _ocr.get());
-        dp->setPollingInterval(dpConfig.pollingInterval);
-        dp->setCoordinate(
-            dpConfig.coordinateDetail.x,
-            dpConfig.coordinateDetail.y,
-            dpConfig.coordinateDetail.width,
-            dpConfig.coordinateDetail.height);
-
         // keep shared_ptr
-        _ocr->addDataPoint(dp);
+        _ocr->addDataPoint(createDataPoint(dpConfig, _ocr.get()));
     }
 
+    _dpConfigFileWatch = std::move(
+        makeFileWatch(_config->datapointConfigFile));
     _dpConfigFileCheck = std::move(
         makeFileCheck(_config->datapointConfigFile));
+    _startupTimeline.mark("setup");
 }
 
 bool Application::run()
 {
+    _workerPool->start();
     if (_ocr->start())
     {
-        _checkDPConfigTimer.start(
-            _checkDPConfigFileInterval,
+        _startupTimeline.mark("ocrStart");
+        if (!_dpConfigFileWatch->start(
+                std::bind(&Application::reloadDPConfig, this)))
+        {
+            LOG(WARNING) << "fall back to polling datapoint config file";
+            _checkDPConfigTimer.start(
+                _checkDPConfigFileInterval,
+                false,
+                std::bind(&Application::checkDPConfig, this, std::placeholders::_1));
+        }
+        _metricsTimer.start(
+            DEFAULT_WRITE_METRICS_INTERVAL,
             false,
-            std::bind(&Application::checkDPConfig, this, std::placeholders::_1));
+            std::bind(&Application::writeMetrics, this, std::placeholders::_1));
+        _startupTimeline.mark("watchConfig");
+        _startupTimeline.log();
         return true;
     }
 
@@ -115,93 +167,129 @@ void Application::checkDPConfig(Timer::system_time const& tp)
     bool modified = _dpConfigFileCheck->checkForFileModification();
     if (!modified)
         return;
-    
+
+    reloadDPConfig();
+}
+
+void Application::reloadDPConfig()
+{
     LOG(INFO) << "datapoint config file modified";
-    auto oldDPConfigs = _config->vDataPointConfig;
+    auto startTime = Timer::steady_clock::now();
+    auto oldDPConfigs = std::move(_config->vDataPointConfig);
     if (!_config->loadDPCOnfig())
     {
         LOG(ERROR) << "check datapoint config file failed";
+        _config->vDataPointConfig = std::move(oldDPConfigs);
         return;
     }
 
-    auto newDPConfigs = _config->vDataPointConfig;
+    auto const& newDPConfigs = _config->vDataPointConfig;
 
-    // check delete and modify
+    std::unordered_map<std::string_view, Config::DataPointConfig const*>
+        oldIndex;
+    oldIndex.reserve(oldDPConfigs.size());
     for (auto const& oldDPConfig : oldDPConfigs)
+        oldIndex.emplace(oldDPConfig.dpId, &oldDPConfig);
+
+    std::vector<std::shared_ptr<DataPoint>> addDPs;
+    std::vector<std::shared_ptr<DataPoint>> modDPs;
+    std::vector<std::string> delIDs;
+
+    // check add and modify
+    for (auto const& newDPConfig : newDPConfigs)
     {
-        bool found = [&]() -> bool {
-            for (auto const& newDPConfig : newDPConfigs)
-            {
-                if (newDPConfig.dpId == oldDPConfig.dpId)
-                {
-                    if (newDPConfig.equalTo(oldDPConfig))
-                        return true;
-
-                    std::shared_ptr<DataPoint> newDP =
-                        makeDataPoint(
-                            NULL,
-                            newDPConfig.dpId,
-                            _config->tessdataPath,
-                            _config->LANGUAGE,
-                            NULL);
-                    newDP->setPollingInterval(newDPConfig.pollingInterval);
-                    newDP->setCoordinate(
-                        newDPConfig.coordinateDetail.x,
-                        newDPConfig.coordinateDetail.y,
-                        newDPConfig.coordinateDetail.width,
-                        newDPConfig.coordinateDetail.height);
-
-                    _ocr->modDataPoint(newDP);
-
-                    return true;
-                }
-            }
-            return false;
-        }();
-
-        if (!found)
+        auto iter = oldIndex.find(newDPConfig.dpId);
+        if (iter == oldIndex.end())
         {
-            _ocr->delDataPoint(oldDPConfig.dpId);
+            addDPs.push_back(createDataPoint(newDPConfig, _ocr.get()));
+            continue;
         }
-    }
 
-    // check add
-    for (auto const& newDPConfig : newDPConfigs)
-    {
-        bool found = [&]() ->bool {
-            for (auto const& oldDPConfig : oldDPConfigs)
-            {
-                if (oldDPConfig.dpId == newDPConfig.dpId)
-                    return true;
-            }
-            return false;
-        }();
-
-        if (!found)
+        auto const& oldDPConfig = *iter->second;
+        if (newDPConfig.hash != oldDPConfig.hash ||
+            !newDPConfig.equalTo(oldDPConfig))
         {
-            std::shared_ptr<DataPoint> newDP =
-                makeDataPoint(
-                    _ocr.get(),
-                    newDPConfig.dpId,
-                    _config->tessdataPath,
-                    _config->LANGUAGE,
-                    _ocr.get());
-            newDP->setPollingInterval(newDPConfig.pollingInterval);
-            newDP->setCoordinate(
-                newDPConfig.coordinateDetail.x,
-                newDPConfig.coordinateDetail.y,
-                newDPConfig.coordinateDetail.width,
-                newDPConfig.coordinateDetail.height);
-
-            _ocr->addDataPoint(newDP);
+            modDPs.push_back(createDataPoint(newDPConfig, NULL));
         }
+        oldIndex.erase(iter);
+    }
+
+    // check delete
+    for (auto const& [id, oldDPConfig] : oldIndex)
+    {
+        (void)oldDPConfig;
+        delIDs.emplace_back(id);
     }
+
+    if (!addDPs.empty() || !modDPs.empty() || !delIDs.empty())
+        _ocr->applyDataPoints(addDPs, modDPs, delIDs);
+
+    // the datapoints the plan was made for changed
+    if (ThreadPlan plan = planThreads();
+        plan.workers != _workerPool->size() ||
+        plan.ompThreads != _workerPool->getOmpThreads())
+    {
+        applyThreadPlan(plan);
+        _workerPool->resize(plan.workers, plan.ompThreads);
+    }
+
+    LOG(INFO) << "datapoint config reloaded, " << newDPConfigs.size()
+        << " datapoints, time escaped "
+        << std::chrono::duration_cast<std::chrono::milliseconds>(
+               Timer::steady_clock::now() - startTime).count()
+        << "ms";
+}
+
+void Application::writeMetrics(Timer::system_time const& tp)
+{
+    (void)tp;
+    Metrics::instance().writeTo(_config->metricsFile);
+}
+
+std::shared_ptr<DataPoint> Application::createDataPoint(
+    Config::DataPointConfig const& dpConfig,
+    Ocr* ocr)
+{
+    std::shared_ptr<DataPoint> dp =
+        makeDataPoint(
+            ocr,
+            dpConfig.dpId,
+            _config->tessdataPath,
+            _config->LANGUAGE,
+            ocr);
+    dp->setPollingInterval(dpConfig.pollingInterval);
+    dp->setCoordinate(
+        dpConfig.coordinateDetail.x,
+        dpConfig.coordinateDetail.y,
+        dpConfig.coordinateDetail.width,
+        dpConfig.coordinateDetail.height);
+    dp->setRule(dpConfig.rule);
+    dp->setRuleError(dpConfig.ruleError);
+    dp->setKeepOriginalValue(dpConfig.keepOriginalValue);
+    dp->setTriggerMode(dpConfig.triggerMode);
+    dp->setGrid({ dpConfig.gridDetail.rows,
+        dpConfig.gridDetail.cols,
+        dpConfig.gridDetail.cellWidth,
+        dpConfig.gridDetail.cellHeight });
+    dp->setEventHeartbeat(_config->mProtocolConfig.eventHeartbeat);
+    dp->setTargetXHeight(_config->mProtocolConfig.targetXHeight);
+    dp->setPolarityDetection(_config->mProtocolConfig.polarityDetection);
+    dp->setAdaptivePolling(_config->mProtocolConfig.adaptivePolling);
+    dp->setRetryPolicy(_config->mProtocolConfig.retry);
+    dp->setSettlePolicy(_config->mProtocolConfig.settle);
+    dp->setVotingPolicy(_config->mProtocolConfig.voting);
+    dp->setOverloadPolicy(_config->mProtocolConfig.overload);
+    dp->setWorkerPool(_workerPool.get());
+    return dp;
 }
 
 void Application::stop()
 {
+    _metricsTimer.stop();
+    _dpConfigFileWatch->stop();
     _checkDPConfigTimer.stop();
     _ocr->stop();
+    _workerPool->stop();
 }
 
 // -----------------------------------------------------------------------
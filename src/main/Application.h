@@ -8,7 +8,10 @@
 #include "main/Config.h"
 #include "core/Ocr.h"
 #include "core/Timer.h"
+#include "core/WorkerPool.h"
 #include "utils/FileCheck.h"
+#include "utils/FileWatch.h"
+#include "utils/Timeline.h"
 
 namespace c2matica {
 
@@ -16,6 +19,7 @@ class Application
 {
 public:
     static const std::uint32_t DEFAULT_CHECK_DP_CONFIG_FILE_INTERVAL = 1000;
+    static const std::uint32_t DEFAULT_WRITE_METRICS_INTERVAL = 5000;
 
 public:
     Application(std::unique_ptr<Config> config);
@@ -29,16 +33,28 @@ public:
 
 private:
     std::unique_ptr<Config> _config;
+    std::unique_ptr<WorkerPool> _workerPool;
     std::unique_ptr<Ocr> _ocr;
 
+    std::unique_ptr<FileWatch> _dpConfigFileWatch;
+    // fallback when inotify is unavailable
     std::unique_ptr<FileCheck> _dpConfigFileCheck;
     std::uint32_t _checkDPConfigFileInterval;
     Timer _checkDPConfigTimer;
+    Timer _metricsTimer;
 
     // stop cv
     std::condition_variable _cv;
 
+    Timeline _startupTimeline;
+
+    ThreadPlan planThreads() const;
     void checkDPConfig(Timer::system_time const &tp);
+    void reloadDPConfig();
+    void writeMetrics(Timer::system_time const& tp);
+    std::shared_ptr<DataPoint> createDataPoint(
+        Config::DataPointConfig const& dpConfig,
+        Ocr* ocr);
 };
 
 std::unique_ptr<Application>
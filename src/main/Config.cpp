@@ -1,9 +1,20 @@
 
 #include <iostream>
 #include <fstream>
+#include <chrono>
+#include <charconv>
+#include <cstring>
+#include <cerrno>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+#include <string_view>
+#include <unordered_set>
 
 #include "3rdparty/easyloggingpp/easylogging++.h"
 #include "main/Config.h"
+#include "main/ConfigCache.h"
+#include "utils/Common.h"
 
 namespace c2matica {
 
@@ -11,6 +22,8 @@ const std::string Config::BASE_PATH = "./";
 const std::string Config::TESSDATA_DIR = "tessdata";
 const std::string Config::PROTOCOL_CONFIG_FILE = "protocolConfig";
 const std::string Config::DATAPOINT_CONFIG_FILE = "dpConfig";
+const std::string Config::DATAPOINT_CACHE_FILE = "dpConfig.cache";
+const std::string Config::METRICS_FILE = "metrics";
 
 Config::Config(std::string base)
 {
@@ -25,9 +38,507 @@ Config::Config(std::string base)
     
     protocolConfigFile = basePath + PROTOCOL_CONFIG_FILE;
     datapointConfigFile = basePath + DATAPOINT_CONFIG_FILE;
+    datapointCacheFile = basePath + DATAPOINT_CACHE_FILE;
+    metricsFile = basePath + METRICS_FILE;
     tessdataPath = basePath + TESSDATA_DIR;
     
     mProtocolConfig.saveOneImage = false;
+    mProtocolConfig.adaptivePolling = { false,
+        DataPoint::DEFAULT_ADAPTIVE_MAX_INTERVAL,
+        DataPoint::DEFAULT_ADAPTIVE_BACKOFF_FACTOR,
+        DataPoint::DEFAULT_ADAPTIVE_STABLE_DISTANCE };
+    mProtocolConfig.retry = { 0, -1 };
+    mProtocolConfig.settle = { 0, 3000 };
+    mProtocolConfig.eventHeartbeat = DataPoint::DEFAULT_EVENT_HEARTBEAT;
+    mProtocolConfig.targetXHeight = 0;
+    mProtocolConfig.polarityDetection = false;
+    mProtocolConfig.voting = { 0, 0, false };
+    mProtocolConfig.overload = { Overload::DEFAULT_DEMOTION_TIMEOUT,
+        Overload::DEFAULT_DEMOTION_PERIOD,
+        Overload::DEFAULT_DEMOTION_FACTOR };
+    mProtocolConfig.workerThreads = 0;
+    mProtocolConfig.parallelism = Parallelism::AUTO;
+    mProtocolConfig.reconnect = { Ocr::DEFAULT_RECONNECT_MAX_INTERVAL,
+        Ocr::DEFAULT_OPEN_TIMEOUT,
+        Ocr::DEFAULT_RECONNECT_JITTER };
+    mProtocolConfig.capture = { "", 0, 0, false, false, 0, 0, false, false };
+    mProtocolConfig.health = { StreamHealth::DEFAULT_FREEZE_TIMEOUT, false };
+    mProtocolConfig.drift = { {}, DriftTracker::DEFAULT_CHECK_INTERVAL,
+        DriftTracker::DEFAULT_SEARCH_RADIUS, DriftTracker::DEFAULT_MIN_SCORE };
+}
+
+namespace {
+
+// Parse "123" without allocating, reject sign, spaces and overflow.
+bool parseUInt32(char const* begin, char const* end, uint32_t& out)
+{
+    auto rc = std::from_chars(begin, end, out);
+    return rc.ec == std::errc() && rc.ptr == end && begin != end;
+}
+
+// Scan the flat coordinateDetail object in place, e.g.
+// {"width":115,"height":14,"x":413,"y":366}
+// Return false on anything unexpected, the caller falls back to json::parse.
+bool scanCoordinateDetail(
+    std::string const& s,
+    Config::DataPointConfig::CoordinateDetail& out)
+{
+    char const* p = s.data();
+    char const* end = p + s.size();
+    auto skipSpace = [&]() {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+            p++;
+    };
+
+    unsigned found = 0;
+    skipSpace();
+    if (p == end || *p++ != '{')
+        return false;
+
+    while (true)
+    {
+        skipSpace();
+        if (p == end || *p++ != '"')
+            return false;
+        char const* key = p;
+        while (p < end && *p != '"' && *p != '\\')
+            p++;
+        if (p == end || *p != '"')
+            return false;
+        std::string_view name(key, p - key);
+        p++;
+
+        skipSpace();
+        if (p == end || *p++ != ':')
+            return false;
+        skipSpace();
+
+        char const* num = p;
+        while (p < end && *p >= '0' && *p <= '9')
+            p++;
+        uint32_t value;
+        if (!parseUInt32(num, p, value))
+            return false;
+
+        if (name == "width")
+            out.width = value, found |= 1;
+        else if (name == "height")
+            out.height = value, found |= 2;
+        else if (name == "x")
+            out.x = value, found |= 4;
+        else if (name == "y")
+            out.y = value, found |= 8;
+
+        skipSpace();
+        if (p == end)
+            return false;
+        if (*p == ',')
+        {
+            p++;
+            continue;
+        }
+        if (*p++ != '}')
+            return false;
+        break;
+    }
+
+    skipSpace();
+    return p == end && found == 0xf;
+}
+
+// Parse rectangles in the format of the dpConfig coordinate column,
+// separated by semicolons, e.g. "413,366/115,14;20,20/64,32".
+bool parseRects(std::string const& s, std::vector<cv::Rect>& out)
+{
+    out.clear();
+    std::size_t begin = 0;
+    while (begin < s.size())
+    {
+        std::size_t end = s.find(';', begin);
+        if (end == std::string::npos)
+            end = s.size();
+
+        uint32_t v[4];
+        char const* p = s.data() + begin;
+        char const* last = s.data() + end;
+        char const separators[] = { ',', '/', ',' };
+        for (int i = 0; i < 4; i++)
+        {
+            char const* q = p;
+            while (q < last && *q >= '0' && *q <= '9')
+                q++;
+            if (!parseUInt32(p, q, v[i]) || v[i] > INT32_MAX)
+                return false;
+            if (i < 3 && (q == last || *q != separators[i]))
+                return false;
+            p = i < 3 ? q + 1 : q;
+        }
+        if (p != last || v[2] == 0 || v[3] == 0)
+            return false;
+        out.emplace_back(v[0], v[1], v[2], v[3]);
+        begin = end + 1;
+    }
+    return true;
+}
+
+// Parse the 9 coefficients of a homography, row major, separated by
+// commas. Return false unless they are numbers and the matrix invertible.
+bool parseHomography(std::string const& s, cv::Matx33d& out)
+{
+    double h[9];
+    std::size_t begin = 0;
+    for (int i = 0; i < 9; i++)
+    {
+        std::size_t end = s.find(',', begin);
+        if ((end == std::string::npos) != (i == 8))
+            return false;
+        if (end == std::string::npos)
+            end = s.size();
+
+        std::string field = s.substr(begin, end - begin);
+        std::size_t pos;
+        try
+        {
+            h[i] = std::stod(field, &pos);
+        }
+        catch (std::exception&)
+        {
+            return false;
+        }
+        while (pos < field.size() && field[pos] == ' ')
+            pos++;
+        if (pos != field.size() || !std::isfinite(h[i]))
+            return false;
+        begin = end + 1;
+    }
+
+    double det = h[0] * (h[4] * h[8] - h[5] * h[7])
+        - h[1] * (h[3] * h[8] - h[5] * h[6])
+        + h[2] * (h[3] * h[7] - h[4] * h[6]);
+    if (std::abs(det) < 1e-12)
+        return false;
+    out = cv::Matx33d(h[0], h[1], h[2], h[3], h[4], h[5], h[6], h[7], h[8]);
+    return true;
+}
+
+// protocolConfig input values are strings, check values are numbers that
+// fit T, converting one that does not is undefined
+template <typename T>
+void getNumberTo(json const& value, T& out)
+{
+    double number;
+    std::string text;
+    if (value.is_number())
+    {
+        number = value.get<double>();
+        text = value.dump();
+    }
+    else if (value.is_string())
+    {
+        text = value.get_ref<std::string const&>();
+        std::size_t pos;
+        number = std::stod(text, &pos);
+        if (pos != text.size())
+            throw std::invalid_argument("`" + text + "' is not a number");
+    }
+    else
+    {
+        value.get_to(out);
+        return;
+    }
+
+    bool fits;
+    if constexpr (std::is_integral_v<T>)
+    {
+        // [lowest, max] of T, max + 1 is exact in a double
+        double bound = std::ldexp(1.0, std::numeric_limits<T>::digits);
+        double lowest = std::is_signed_v<T> ? -bound : 0;
+        fits = number >= lowest && number < bound;
+    }
+    else
+    {
+        fits = std::isfinite(number) &&
+            std::fabs(number) <= std::numeric_limits<T>::max();
+    }
+    if (!fits)
+        throw std::out_of_range("`" + text + "' is out of range");
+    out = static_cast<T>(number);
+}
+
+// SAX handler of dpConfig, a JSON array whose first row is the header and
+// following rows are datapoints. Rows are converted to DataPointConfig as
+// the values stream by, without building the json DOM.
+class DPConfigParser : public nlohmann::json_sax<json>
+{
+public:
+    bool null() override { return value(NULL); }
+    bool boolean(bool val) override
+    {
+        // boolean columns, e.g. keepOriginalValue, may be written unquoted
+        std::string s = val ? "true" : "false";
+        return value(&s);
+    }
+    bool number_integer(number_integer_t val) override
+    {
+        std::string s = std::to_string(val);
+        return value(&s);
+    }
+    bool number_unsigned(number_unsigned_t val) override
+    {
+        std::string s = std::to_string(val);
+        return value(&s);
+    }
+    bool number_float(number_float_t val, const string_t& s) override
+    {
+        (void)val;
+        return fail("unexpected float `" + s + "'");
+    }
+    bool string(string_t& val) override { return value(&val); }
+    bool binary(binary_t& val) override
+    {
+        (void)val;
+        return fail("unexpected binary value");
+    }
+    bool start_object(std::size_t elements) override
+    {
+        (void)elements;
+        return fail("unexpected object");
+    }
+    bool key(string_t& val) override
+    {
+        (void)val;
+        return fail("unexpected key");
+    }
+    bool end_object() override { return fail("unexpected object"); }
+
+    bool start_array(std::size_t elements) override
+    {
+        (void)elements;
+        if (++_depth > 2)
+            return fail("unexpected nested array");
+        if (_depth == 2)
+        {
+            _column = 0;
+            _row = {};
+            _row.pollingInterval = 0;
+            _row.triggerMode = DataPoint::TriggerMode::POLLING;
+            _row.gridDetail = { 0, 0, 0, 0 };
+            _row.keepOriginalValue = true;
+            _seen = 0;
+        }
+        return true;
+    }
+
+    bool end_array() override
+    {
+        if (_depth-- == 2)
+            return _rowIndex++ == 0 ? endHeader() : endRow();
+        return true;
+    }
+
+    bool parse_error(
+        std::size_t position,
+        const std::string& last_token,
+        const nlohmann::detail::exception& ex) override
+    {
+        (void)last_token;
+        return fail("at " + std::to_string(position) + ": " + ex.what());
+    }
+
+    std::string const& error() const { return _error; }
+
+    std::vector<Config::DataPointConfig> release()
+    {
+        if (_rowIndex == 0)
+            throw std::invalid_argument("dpConfig missing header");
+        return std::move(_rows);
+    }
+
+private:
+    enum Column
+    {
+        UNKNOWN = 0,
+        DPID,
+        POLLING_INTERVAL,
+        COORDINATE_DETAIL,
+        DPUNIT,
+        RULE_CONTENT,
+        RULE_ARGS,
+        RULE_IDENT,
+        TRIGGER_MODE,
+        GRID_DETAIL,
+        KEEP_ORIGINAL_VALUE,
+    };
+    static const unsigned REQUIRED =
+        1 << DPID | 1 << POLLING_INTERVAL | 1 << COORDINATE_DETAIL;
+
+    int _depth = 0;
+    std::size_t _rowIndex = 0;
+    std::size_t _column = 0;
+    std::vector<Column> _header;
+    unsigned _seen = 0;
+    Config::DataPointConfig _row;
+    std::vector<Config::DataPointConfig> _rows;
+    std::unordered_set<std::string> _ids;
+    std::string _error;
+
+    bool fail(std::string error)
+    {
+        if (_error.empty())
+        {
+            _error = std::move(error);
+            if (_rowIndex > 0)
+                _error += " (row " + std::to_string(_rowIndex) + ")";
+        }
+        return false;
+    }
+
+    // val is NULL for values that are not string or number
+    bool value(std::string* val)
+    {
+        if (_depth != 2)
+            return fail("datapoint row must be an array");
+
+        std::size_t column = _column++;
+        if (_rowIndex == 0)
+        {
+            if (!val)
+                return fail("header column must be a string");
+            _header.push_back(
+                *val == "dpId"             ? DPID :
+                *val == "pollingInterval"  ? POLLING_INTERVAL :
+                *val == "coordinateDetail" ? COORDINATE_DETAIL :
+                *val == "dpUnit"           ? DPUNIT :
+                *val == "ruleContent"      ? RULE_CONTENT :
+                *val == "ruleArgs"         ? RULE_ARGS :
+                *val == "ruleIdent"        ? RULE_IDENT :
+                *val == "triggerMode"      ? TRIGGER_MODE :
+                *val == "gridDetail"       ? GRID_DETAIL :
+                *val == "keepOriginalValue" ? KEEP_ORIGINAL_VALUE :
+                                             UNKNOWN);
+            return true;
+        }
+
+        Column type = column < _header.size() ? _header[column] : UNKNOWN;
+        if (type == UNKNOWN)
+            return true;
+        if (!val)
+            return fail("column " + std::to_string(column) + " must be a string");
+
+        _seen |= 1 << type;
+        switch (type)
+        {
+            case DPID:
+                _row.dpId = std::move(*val);
+                break;
+            case POLLING_INTERVAL:
+                if (!parseUInt32(val->data(), val->data() + val->size(),
+                        _row.pollingInterval))
+                    return fail("bad pollingInterval `" + *val + "'");
+                break;
+            case COORDINATE_DETAIL:
+                if (!scanCoordinateDetail(*val, _row.coordinateDetail))
+                {
+                    try
+                    {
+                        _row.coordinateDetail = json::parse(*val)
+                            .get<Config::DataPointConfig::CoordinateDetail>();
+                    }
+                    catch (std::exception& e)
+                    {
+                        return fail("bad coordinateDetail `" + *val
+                            + "': " + e.what());
+                    }
+                }
+                break;
+            case DPUNIT:
+                _row.dpUnit = std::move(*val);
+                break;
+            case RULE_CONTENT:
+                _row.ruleContent = std::move(*val);
+                break;
+            case RULE_ARGS:
+                _row.ruleArgs = std::move(*val);
+                break;
+            case RULE_IDENT:
+                _row.ruleIdent = std::move(*val);
+                break;
+            case TRIGGER_MODE:
+                // empty keeps polling
+                if (!val->empty() &&
+                    !DataPoint::parseTriggerMode(*val, _row.triggerMode))
+                    return fail("bad triggerMode `" + *val + "'");
+                break;
+            case GRID_DETAIL:
+                // empty for a single value datapoint
+                if (val->empty())
+                    break;
+                try
+                {
+                    _row.gridDetail = json::parse(*val)
+                        .get<Config::DataPointConfig::GridDetail>();
+                }
+                catch (std::exception& e)
+                {
+                    return fail("bad gridDetail `" + *val + "': " + e.what());
+                }
+                if (_row.gridDetail.rows == 0 || _row.gridDetail.cols == 0 ||
+                    _row.gridDetail.cellWidth == 0 ||
+                    _row.gridDetail.cellHeight == 0 ||
+                    (uint64_t)_row.gridDetail.cols * _row.gridDetail.cellWidth
+                        > UINT32_MAX ||
+                    (uint64_t)_row.gridDetail.rows * _row.gridDetail.cellHeight
+                        > UINT32_MAX)
+                    return fail("bad gridDetail `" + *val + "'");
+                break;
+            case KEEP_ORIGINAL_VALUE:
+                // empty keeps it
+                if (*val == "false")
+                    _row.keepOriginalValue = false;
+                else if (!val->empty() && *val != "true")
+                    return fail("bad keepOriginalValue `" + *val + "'");
+                break;
+            case UNKNOWN:
+                break;
+        }
+        return true;
+    }
+
+    bool endHeader()
+    {
+        unsigned columns = 0;
+        for (auto type : _header)
+            columns |= 1 << type;
+        if ((columns & REQUIRED) != REQUIRED)
+            return fail("dpConfig missing column");
+        return true;
+    }
+
+    bool endRow()
+    {
+        if ((_seen & REQUIRED) != REQUIRED)
+            return fail("datapoint missing column");
+        if (_row.dpId.empty())
+            return fail("empty dpId");
+        if (auto const& grid = _row.gridDetail; grid.rows > 0)
+        {
+            // the region spans the grid from the coordinate origin
+            _row.coordinateDetail.width = grid.cols * grid.cellWidth;
+            _row.coordinateDetail.height = grid.rows * grid.cellHeight;
+        }
+        // Ocr keeps the first datapoint of an id, later duplicates are
+        // dropped so the thread plan does not count them
+        if (!_ids.insert(_row.dpId).second)
+        {
+            LOG(WARNING) << "dpConfig duplicated dpId " << _row.dpId
+                << " ignored";
+            return true;
+        }
+        _rows.push_back(std::move(_row));
+        return true;
+    }
+};
+
 }
 
 bool Config::load()
@@ -35,6 +546,8 @@ bool Config::load()
     LOG(INFO) << "basePath=" << basePath;
     LOG(INFO) << "protocolConfigFile=" << protocolConfigFile;
     LOG(INFO) << "datapointConfigFile=" << datapointConfigFile;
+    LOG(INFO) << "datapointCacheFile=" << datapointCacheFile;
+    LOG(INFO) << "metricsFile=" << metricsFile;
     LOG(INFO) << "tessdataPath=" << tessdataPath;
  
     return loadAppConfig() && loadDPCOnfig();
@@ -73,6 +586,220 @@ bool Config::loadAppConfig()
             {
                 protocolConfig[i].at("value").get_to(mProtocolConfig.saveOneImage);
             }
+            else if (category == "adaptivePolling")
+            {
+                protocolConfig[i].at("value").get_to(
+                    mProtocolConfig.adaptivePolling.enabled);
+            }
+            else if (category == "adaptiveMaxInterval")
+            {
+                getNumberTo(protocolConfig[i].at("value"),
+                    mProtocolConfig.adaptivePolling.maxInterval);
+            }
+            else if (category == "adaptiveBackoffFactor")
+            {
+                getNumberTo(protocolConfig[i].at("value"),
+                    mProtocolConfig.adaptivePolling.backoffFactor);
+            }
+            else if (category == "adaptiveStableDistance")
+            {
+                getNumberTo(protocolConfig[i].at("value"),
+                    mProtocolConfig.adaptivePolling.stableDistance);
+            }
+            else if (category == "demotionTimeout")
+            {
+                getNumberTo(protocolConfig[i].at("value"),
+                    mProtocolConfig.overload.demotionTimeout);
+            }
+            else if (category == "demotionPeriod")
+            {
+                getNumberTo(protocolConfig[i].at("value"),
+                    mProtocolConfig.overload.demotionPeriod);
+            }
+            else if (category == "demotionFactor")
+            {
+                getNumberTo(protocolConfig[i].at("value"),
+                    mProtocolConfig.overload.demotionFactor);
+            }
+            else if (category == "workerThreads")
+            {
+                getNumberTo(protocolConfig[i].at("value"),
+                    mProtocolConfig.workerThreads);
+            }
+            else if (category == "parallelism")
+            {
+                std::string parallelism;
+                protocolConfig[i].at("value").get_to(parallelism);
+                if (!parseParallelism(parallelism, mProtocolConfig.parallelism))
+                {
+                    LOG(ERROR) << "malformed protocolConfig file: "
+                               << "parallelism must be auto, inter or intra";
+                    return false;
+                }
+            }
+            else if (category == "reconnectMaxInterval")
+            {
+                getNumberTo(protocolConfig[i].at("value"),
+                    mProtocolConfig.reconnect.maxInterval);
+            }
+            else if (category == "openTimeout")
+            {
+                getNumberTo(protocolConfig[i].at("value"),
+                    mProtocolConfig.reconnect.openTimeout);
+            }
+            else if (category == "rtspTransport")
+            {
+                protocolConfig[i].at("value").get_to(
+                    mProtocolConfig.capture.rtspTransport);
+            }
+            else if (category == "probesize")
+            {
+                getNumberTo(protocolConfig[i].at("value"),
+                    mProtocolConfig.capture.probesize);
+            }
+            else if (category == "analyzeDuration")
+            {
+                getNumberTo(protocolConfig[i].at("value"),
+                    mProtocolConfig.capture.analyzeDuration);
+            }
+            else if (category == "fflagsNobuffer")
+            {
+                protocolConfig[i].at("value").get_to(
+                    mProtocolConfig.capture.noBuffer);
+            }
+            else if (category == "lowDelay")
+            {
+                protocolConfig[i].at("value").get_to(
+                    mProtocolConfig.capture.lowDelay);
+            }
+            else if (category == "decodeThreads")
+            {
+                getNumberTo(protocolConfig[i].at("value"),
+                    mProtocolConfig.capture.decodeThreads);
+            }
+            else if (category == "socketTimeout")
+            {
+                getNumberTo(protocolConfig[i].at("value"),
+                    mProtocolConfig.capture.socketTimeout);
+            }
+            else if (category == "framePoolHugePages")
+            {
+                protocolConfig[i].at("value").get_to(
+                    mProtocolConfig.capture.hugePages);
+            }
+            else if (category == "roiGray")
+            {
+                protocolConfig[i].at("value").get_to(
+                    mProtocolConfig.capture.roiGray);
+            }
+            else if (category == "retryConfidence")
+            {
+                getNumberTo(protocolConfig[i].at("value"),
+                    mProtocolConfig.retry.minConfidence);
+            }
+            else if (category == "retryPsm")
+            {
+                getNumberTo(protocolConfig[i].at("value"),
+                    mProtocolConfig.retry.alternatePsm);
+            }
+            else if (category == "voteWindow")
+            {
+                getNumberTo(protocolConfig[i].at("value"),
+                    mProtocolConfig.voting.window);
+            }
+            else if (category == "voteQuorum")
+            {
+                getNumberTo(protocolConfig[i].at("value"),
+                    mProtocolConfig.voting.quorum);
+            }
+            else if (category == "voteWeighted")
+            {
+                protocolConfig[i].at("value").get_to(
+                    mProtocolConfig.voting.weighted);
+            }
+            else if (category == "settleTime")
+            {
+                getNumberTo(protocolConfig[i].at("value"),
+                    mProtocolConfig.settle.settleTime);
+            }
+            else if (category == "settleMaxDeferral")
+            {
+                getNumberTo(protocolConfig[i].at("value"),
+                    mProtocolConfig.settle.maxDeferral);
+            }
+            else if (category == "eventHeartbeat")
+            {
+                getNumberTo(protocolConfig[i].at("value"),
+                    mProtocolConfig.eventHeartbeat);
+            }
+            else if (category == "targetXHeight")
+            {
+                getNumberTo(protocolConfig[i].at("value"),
+                    mProtocolConfig.targetXHeight);
+            }
+            else if (category == "polarityDetection")
+            {
+                protocolConfig[i].at("value").get_to(
+                    mProtocolConfig.polarityDetection);
+            }
+            else if (category == "perspective")
+            {
+                std::string perspective;
+                protocolConfig[i].at("value").get_to(perspective);
+                cv::Matx33d homography;
+                if (perspective.empty())
+                {
+                    mProtocolConfig.perspective.reset();
+                }
+                else if (parseHomography(perspective, homography))
+                {
+                    mProtocolConfig.perspective = homography;
+                }
+                else
+                {
+                    LOG(ERROR) << "malformed protocolConfig file: "
+                               << "perspective must be 9 comma separated "
+                               << "numbers of an invertible homography";
+                    return false;
+                }
+            }
+            else if (category == "driftAnchors")
+            {
+                std::string anchors;
+                protocolConfig[i].at("value").get_to(anchors);
+                if (!parseRects(anchors, mProtocolConfig.drift.anchors))
+                {
+                    LOG(ERROR) << "malformed protocolConfig file: "
+                               << "driftAnchors must be x,y/width,height "
+                               << "separated by ;";
+                    return false;
+                }
+            }
+            else if (category == "driftCheckInterval")
+            {
+                getNumberTo(protocolConfig[i].at("value"),
+                    mProtocolConfig.drift.checkInterval);
+            }
+            else if (category == "driftSearchRadius")
+            {
+                getNumberTo(protocolConfig[i].at("value"),
+                    mProtocolConfig.drift.searchRadius);
+            }
+            else if (category == "driftMinScore")
+            {
+                getNumberTo(protocolConfig[i].at("value"),
+                    mProtocolConfig.drift.minScore);
+            }
+            else if (category == "freezeTimeout")
+            {
+                getNumberTo(protocolConfig[i].at("value"),
+                    mProtocolConfig.health.freezeTimeout);
+            }
+            else if (category == "freezeReconnect")
+            {
+                protocolConfig[i].at("value").get_to(
+                    mProtocolConfig.health.reconnectOnFreeze);
+            }
         }
     }
     catch (std::exception& e)
@@ -88,15 +815,71 @@ bool Config::loadAppConfig()
         return false;
     }
 
+    if (auto const& transport = mProtocolConfig.capture.rtspTransport;
+        !transport.empty() && transport != "tcp" && transport != "udp")
+    {
+        LOG(ERROR) << "malformed protocolConfig file: "
+                   << "rtspTransport must be tcp or udp";
+        return false;
+    }
+
+    if (mProtocolConfig.drift.searchRadius < 1 ||
+        mProtocolConfig.drift.minScore < 0 || mProtocolConfig.drift.minScore > 1)
+    {
+        LOG(ERROR) << "malformed protocolConfig file: "
+                   << "driftSearchRadius must be positive, driftMinScore 0..1";
+        return false;
+    }
+
+    if (mProtocolConfig.retry.minConfidence > 100 ||
+        mProtocolConfig.retry.alternatePsm > 13)
+    {
+        LOG(ERROR) << "malformed protocolConfig file: "
+                   << "retryConfidence must be 0..100, retryPsm -1..13";
+        return false;
+    }
+
+    if (mProtocolConfig.voting.window > 1 &&
+        (mProtocolConfig.voting.quorum < 1 ||
+         mProtocolConfig.voting.quorum > mProtocolConfig.voting.window))
+    {
+        LOG(ERROR) << "malformed protocolConfig file: "
+                   << "voteQuorum must be 1..voteWindow";
+        return false;
+    }
+
+    if (mProtocolConfig.reconnect.openTimeout <= 0)
+    {
+        LOG(ERROR) << "malformed protocolConfig file: "
+                   << "openTimeout must be greater than 0";
+        return false;
+    }
+
+    if (mProtocolConfig.adaptivePolling.backoffFactor < 1)
+    {
+        LOG(ERROR) << "malformed protocolConfig file: "
+                   << "adaptiveBackoffFactor must not be less than 1";
+        return false;
+    }
+
     return true;
 }
 
 bool Config::loadDPCOnfig()
 {
-    json j;
+    std::string content;
     try {
-        std::ifstream i(datapointConfigFile);
-        i >> j;
+        std::ifstream i(datapointConfigFile, std::ios::binary);
+        if (!i)
+            throw std::runtime_error(strerror(errno));
+        i.seekg(0, std::ios::end);
+        std::streamoff size = i.tellg();
+        if (size < 0)
+            throw std::runtime_error("size unknown");
+        content.resize(size);
+        i.seekg(0, std::ios::beg);
+        if (!i.read(content.data(), content.size()))
+            throw std::runtime_error("short read");
         i.close();
     }
     catch (std::exception& e)
@@ -109,43 +892,43 @@ bool Config::loadDPCOnfig()
     LOG(INFO) << "dpConfig file `" << datapointConfigFile << "' open success";
 
     try {
-        std::optional<int> posDPID;
-        std::optional<int> posPollingInterval;
-        std::optional<int> posCoordinateDetail;
-        json header = j[0];
-        for (std::size_t i = 0; i < header.size(); i++)
-        {
-            if (header[i] == "dpId")
-                posDPID = i;
-            else if (header[i] == "pollingInterval")
-                posPollingInterval = i;
-            else if (header[i] == "coordinateDetail")
-                posCoordinateDetail = i;
-        }
-        if (!posDPID || !posPollingInterval || !posCoordinateDetail)
+        auto startTime = std::chrono::steady_clock::now();
+        uint64_t sourceHash = hash64(content.data(), content.size());
+        std::vector<struct DataPointConfig> tmp;
+        bool cached = loadConfigCache(datapointCacheFile, sourceHash, tmp);
+        if (!cached)
         {
-            LOG(ERROR) << "dpConfig missing column";
-            return false;
+            DPConfigParser parser;
+            if (!json::sax_parse(content, &parser))
+            {
+                LOG(ERROR) << "parse dpConfig file failed: " << parser.error();
+                return false;
+            }
+            tmp = parser.release();
         }
 
-        std::vector<struct DataPointConfig> tmp;
+        std::unordered_map<std::string, std::shared_ptr<const Rule>> ruleCache;
 
-        for (std::size_t i = 1; i < j.size(); i++)
+        for (auto& dataPointConfig : tmp)
         {
-            struct DataPointConfig dataPointConfig;
-            dataPointConfig.dpId = j[i][*posDPID];
-            dataPointConfig.pollingInterval =
-                stoi(j[i][*posPollingInterval].get<std::string>());
+            dataPointConfig.rule = compileRule(dataPointConfig, ruleCache,
+                dataPointConfig.ruleError);
+            dataPointConfig.hash = dataPointConfig.hashOf();
+        }
 
-            json coordinateDetail = 
-                json::parse(j[i][*posCoordinateDetail].get<std::string>());
-            dataPointConfig.coordinateDetail = coordinateDetail
-                .get<DataPointConfig::CoordinateDetail>();
+        LOG(INFO) << "dpConfig " << tmp.size() << " datapoints loaded from "
+            << (cached ? "cache" : "source") << " in "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(
+                   std::chrono::steady_clock::now() - startTime).count()
+            << "ms";
 
-            tmp.push_back(dataPointConfig);
-        };
+        // validated rows only, rules compiled above
+        if (!cached)
+            saveConfigCache(datapointCacheFile, sourceHash, tmp);
 
         vDataPointConfig = std::move(tmp);
+        // drop rules no longer referenced
+        _ruleCache = std::move(ruleCache);
     }
     catch (std::exception& e)
     {
@@ -156,4 +939,55 @@ bool Config::loadDPCOnfig()
     return true;
 }
 
+std::shared_ptr<const Rule> Config::compileRule(
+    DataPointConfig const& dataPointConfig,
+    std::unordered_map<std::string, std::shared_ptr<const Rule>>& cache,
+    std::string& error)
+{
+    error.clear();
+    if (dataPointConfig.ruleContent.empty() && dataPointConfig.dpUnit.empty())
+        return NULL;
+
+    std::string key = Rule::cacheKey(
+        dataPointConfig.ruleIdent,
+        dataPointConfig.ruleContent,
+        dataPointConfig.ruleArgs,
+        dataPointConfig.dpUnit);
+
+    if (auto iter = cache.find(key); iter != cache.end())
+        return iter->second;
+
+    std::shared_ptr<const Rule> rule;
+    if (auto iter = _ruleCache.find(key); iter != _ruleCache.end())
+    {
+        rule = iter->second;
+    }
+    else
+    {
+        try
+        {
+            rule = makeRule(
+                dataPointConfig.ruleIdent,
+                dataPointConfig.ruleContent,
+                dataPointConfig.ruleArgs,
+                dataPointConfig.dpUnit);
+        }
+        catch (std::exception& e)
+        {
+            // one row must not keep the others from loading, the datapoint
+            // publishes its raw text with the error instead
+            error = std::string("rule not compiled: ") + e.what();
+            LOG(ERROR) << "datapoint " << dataPointConfig.dpId
+                << " compile rule `" << dataPointConfig.ruleContent
+                << "' failed: " << e.what();
+            return NULL;
+        }
+        LOG(INFO) << "datapoint " << dataPointConfig.dpId
+            << " rule compiled: " << dataPointConfig.ruleContent;
+    }
+
+    cache.emplace(key, rule);
+    return rule;
+}
+
 }
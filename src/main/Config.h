@@ -5,10 +5,14 @@
 #include <string>
 #include <optional>
 #include <vector>
+#include <memory>
+#include <unordered_map>
 
 #include "3rdparty/nlohmann/json.hpp"
 #include "core/Ocr.h"
 #include "core/DataPoint.h"
+#include "core/Rule.h"
+#include "core/ThreadGovernor.h"
 
 using json = nlohmann::json;
 
@@ -24,6 +28,26 @@ public:
     {
         std::string streamURL;
         bool saveOneImage;
+        DataPoint::AdaptivePolling adaptivePolling;
+        DataPoint::RetryPolicy retry;
+        DataPoint::SettlePolicy settle;
+        // ms, read of an unchanged event datapoint, 0 never
+        uint32_t eventHeartbeat;
+        // px, regions are rescaled to this text x-height, 0 never
+        uint32_t targetXHeight;
+        // invert light on dark regions, the engine never does
+        bool polarityDetection;
+        Voting::Policy voting;
+        Overload::Policy overload;
+        // recognition workers, 0 sized from cpus and cgroup quota
+        uint32_t workerThreads;
+        Parallelism parallelism;
+        Ocr::ReconnectPolicy reconnect;
+        Ocr::CaptureOptions capture;
+        StreamHealth::Policy health;
+        DriftTracker::Policy drift;
+        // frame to the rectified view the coordinates refer to
+        std::optional<cv::Matx33d> perspective;
     };
 
     struct DataPointConfig
@@ -39,6 +63,51 @@ public:
             NLOHMANN_DEFINE_TYPE_INTRUSIVE(
                 DataPointConfig::CoordinateDetail, width, height, x, y);
         } coordinateDetail;
+        // a table of cells from the coordinate origin, rows 0 without
+        struct GridDetail {
+            uint32_t rows;
+            uint32_t cols;
+            uint32_t cellWidth;
+            uint32_t cellHeight;
+
+            NLOHMANN_DEFINE_TYPE_INTRUSIVE(
+                DataPointConfig::GridDetail, rows, cols, cellWidth, cellHeight);
+        } gridDetail;
+        std::string dpUnit;
+        std::string ruleContent;
+        std::string ruleArgs;
+        std::string ruleIdent;
+        DataPoint::TriggerMode triggerMode;
+        // publish rawValue next to the value of a rule
+        bool keepOriginalValue;
+        // compiled from rule* columns, NULL if ruleContent is empty
+        std::shared_ptr<const Rule> rule;
+        // why the rule did not compile, the raw text is published then
+        std::string ruleError;
+        // content hash of the row, for diffing reloads
+        std::size_t hash;
+
+        std::size_t hashOf() const
+        {
+            std::size_t h = std::hash<std::string>()(dpId);
+            auto combine = [&h](std::size_t v) {
+                h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+            };
+            combine(pollingInterval);
+            combine(coordinateDetail.x);
+            combine(coordinateDetail.y);
+            combine(coordinateDetail.width);
+            combine(coordinateDetail.height);
+            combine((std::size_t)triggerMode);
+            combine(gridDetail.rows);
+            combine(gridDetail.cols);
+            combine(gridDetail.cellWidth);
+            combine(gridDetail.cellHeight);
+            combine(keepOriginalValue);
+            combine(std::hash<const Rule*>()(rule.get()));
+            combine(std::hash<std::string>()(ruleError));
+            return h;
+        }
 
         bool equalTo(DataPointConfig const& other) const
         {
@@ -46,7 +115,15 @@ public:
                 coordinateDetail.x == other.coordinateDetail.x && 
                 coordinateDetail.y == other.coordinateDetail.y &&
                 coordinateDetail.width == other.coordinateDetail.width &&
-                coordinateDetail.height == other.coordinateDetail.height;
+                coordinateDetail.height == other.coordinateDetail.height &&
+                triggerMode == other.triggerMode &&
+                gridDetail.rows == other.gridDetail.rows &&
+                gridDetail.cols == other.gridDetail.cols &&
+                gridDetail.cellWidth == other.gridDetail.cellWidth &&
+                gridDetail.cellHeight == other.gridDetail.cellHeight &&
+                keepOriginalValue == other.keepOriginalValue &&
+                rule == other.rule &&
+                ruleError == other.ruleError;
         }
     };
     bool load();
@@ -56,6 +133,8 @@ public:
     static const std::string TESSDATA_DIR;
     static const std::string PROTOCOL_CONFIG_FILE;
     static const std::string DATAPOINT_CONFIG_FILE;
+    static const std::string DATAPOINT_CACHE_FILE;
+    static const std::string METRICS_FILE;
 
 public:
     const int32_t RECONNECT_INTERVAL = Ocr::DEFAULT_RECONNECT_INTERVAL;
@@ -65,6 +144,8 @@ public:
     std::string tessdataPath;
     std::string protocolConfigFile;
     std::string datapointConfigFile;
+    std::string datapointCacheFile;
+    std::string metricsFile;
 
 public:
     struct ProtocolConfig mProtocolConfig;
@@ -75,6 +156,14 @@ public:
 
 private:
     bool loadAppConfig();
+
+    // compiled rules keyed by Rule::cacheKey, kept across dpConfig reloads
+    std::unordered_map<std::string, std::shared_ptr<const Rule>> _ruleCache;
+    // NULL and error set if the rule does not compile
+    std::shared_ptr<const Rule> compileRule(
+        DataPointConfig const& dataPointConfig,
+        std::unordered_map<std::string, std::shared_ptr<const Rule>>& cache,
+        std::string& error);
 };
 
 }
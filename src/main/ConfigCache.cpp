@@ -0,0 +1,235 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+
+#include "3rdparty/easyloggingpp/easylogging++.h"
+#include "main/ConfigCache.h"
+#include "utils/Common.h"
+
+namespace c2matica {
+
+static const char CACHE_MAGIC[8] = { 'C', '2', 'M', 'D', 'P', 'C', 0, 0 };
+static const uint32_t CACHE_VERSION = 4;
+
+struct CacheHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t count;
+    uint64_t sourceHash;
+    uint64_t poolSize;
+    // hash64 of records and pool
+    uint64_t checksum;
+};
+
+struct CacheString
+{
+    uint32_t offset;
+    uint32_t length;
+};
+
+struct CacheRecord
+{
+    uint32_t pollingInterval;
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+    uint32_t triggerMode;
+    uint32_t gridRows;
+    uint32_t gridCols;
+    uint32_t gridCellWidth;
+    uint32_t gridCellHeight;
+    uint32_t keepOriginalValue;
+    CacheString dpId;
+    CacheString dpUnit;
+    CacheString ruleContent;
+    CacheString ruleArgs;
+    CacheString ruleIdent;
+};
+
+bool loadConfigCache(
+    std::string const& file,
+    uint64_t sourceHash,
+    std::vector<Config::DataPointConfig>& out)
+{
+    int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (std::size_t)st.st_size < sizeof(CacheHeader))
+    {
+        close(fd);
+        return false;
+    }
+
+    std::size_t size = st.st_size;
+    void* addr = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+    {
+        LOG(WARNING) << "mmap config cache " << file << " failed: "
+            << strerror(errno);
+        return false;
+    }
+
+    auto base = static_cast<char const*>(addr);
+    bool ok = [&]() -> bool {
+        CacheHeader header;
+        std::memcpy(&header, base, sizeof(header));
+        if (std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) ||
+            header.version != CACHE_VERSION)
+        {
+            LOG(INFO) << "config cache " << file << " version mismatch";
+            return false;
+        }
+        if (header.sourceHash != sourceHash)
+        {
+            LOG(INFO) << "config cache " << file << " is stale";
+            return false;
+        }
+
+        std::size_t recordsSize = (std::size_t)header.count * sizeof(CacheRecord);
+        if (sizeof(header) + recordsSize + header.poolSize != size)
+            return false;
+        char const* records = base + sizeof(header);
+        char const* pool = records + recordsSize;
+        if (hash64(records, recordsSize + header.poolSize) != header.checksum)
+        {
+            LOG(WARNING) << "config cache " << file << " checksum mismatch";
+            return false;
+        }
+
+        auto toString = [&](CacheString const& s, std::string& to) {
+            if ((uint64_t)s.offset + s.length > header.poolSize)
+                return false;
+            to.assign(pool + s.offset, s.length);
+            return true;
+        };
+
+        std::vector<Config::DataPointConfig> rows(header.count);
+        for (uint32_t i = 0; i < header.count; i++)
+        {
+            CacheRecord record;
+            std::memcpy(&record, records + i * sizeof(CacheRecord),
+                sizeof(record));
+
+            auto& row = rows[i];
+            row.pollingInterval = record.pollingInterval;
+            row.coordinateDetail.x = record.x;
+            row.coordinateDetail.y = record.y;
+            row.coordinateDetail.width = record.width;
+            row.coordinateDetail.height = record.height;
+            if (record.triggerMode > (uint32_t)DataPoint::TriggerMode::EVENT)
+                return false;
+            row.triggerMode = (DataPoint::TriggerMode)record.triggerMode;
+            row.gridDetail = { record.gridRows, record.gridCols,
+                record.gridCellWidth, record.gridCellHeight };
+            row.keepOriginalValue = record.keepOriginalValue != 0;
+            if (!toString(record.dpId, row.dpId) ||
+                !toString(record.dpUnit, row.dpUnit) ||
+                !toString(record.ruleContent, row.ruleContent) ||
+                !toString(record.ruleArgs, row.ruleArgs) ||
+                !toString(record.ruleIdent, row.ruleIdent))
+                return false;
+        }
+
+        out = std::move(rows);
+        return true;
+    }();
+
+    munmap(addr, size);
+    return ok;
+}
+
+bool saveConfigCache(
+    std::string const& file,
+    uint64_t sourceHash,
+    std::vector<Config::DataPointConfig> const& rows)
+{
+    std::string pool;
+    std::string records;
+    records.resize(rows.size() * sizeof(CacheRecord));
+
+    auto toCache = [&pool](std::string const& s) {
+        CacheString cs{ (uint32_t)pool.size(), (uint32_t)s.size() };
+        pool.append(s);
+        return cs;
+    };
+
+    for (std::size_t i = 0; i < rows.size(); i++)
+    {
+        auto const& row = rows[i];
+        CacheRecord record;
+        std::memset(&record, 0, sizeof(record));
+        record.pollingInterval = row.pollingInterval;
+        record.x = row.coordinateDetail.x;
+        record.y = row.coordinateDetail.y;
+        record.width = row.coordinateDetail.width;
+        record.height = row.coordinateDetail.height;
+        record.triggerMode = (uint32_t)row.triggerMode;
+        record.gridRows = row.gridDetail.rows;
+        record.gridCols = row.gridDetail.cols;
+        record.gridCellWidth = row.gridDetail.cellWidth;
+        record.gridCellHeight = row.gridDetail.cellHeight;
+        record.keepOriginalValue = row.keepOriginalValue;
+        record.dpId = toCache(row.dpId);
+        record.dpUnit = toCache(row.dpUnit);
+        record.ruleContent = toCache(row.ruleContent);
+        record.ruleArgs = toCache(row.ruleArgs);
+        record.ruleIdent = toCache(row.ruleIdent);
+        std::memcpy(records.data() + i * sizeof(CacheRecord),
+            &record, sizeof(record));
+    }
+
+    if (pool.size() > UINT32_MAX)
+    {
+        LOG(WARNING) << "config cache string pool too large";
+        return false;
+    }
+
+    records.append(pool);
+
+    CacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version = CACHE_VERSION;
+    header.count = rows.size();
+    header.sourceHash = sourceHash;
+    header.poolSize = pool.size();
+    header.checksum = hash64(records.data(), records.size());
+
+    // write a temporary file and rename, readers never see a torn cache
+    std::string tmpFile = file + ".tmp";
+    FILE* fp = fopen(tmpFile.c_str(), "wb");
+    if (!fp)
+    {
+        LOG(WARNING) << "open config cache " << tmpFile << " failed: "
+            << strerror(errno);
+        return false;
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+        fwrite(records.data(), 1, records.size(), fp) == records.size();
+    ok = (fclose(fp) == 0) && ok;
+    if (!ok || rename(tmpFile.c_str(), file.c_str()) != 0)
+    {
+        LOG(WARNING) << "write config cache " << file << " failed: "
+            << strerror(errno);
+        unlink(tmpFile.c_str());
+        return false;
+    }
+
+    LOG(INFO) << "config cache " << file << " saved, "
+        << rows.size() << " datapoints";
+    return true;
+}
+
+}
@@ -0,0 +1,38 @@
+#ifndef _C2MATICA_CONFIGCACHE_H_
+#define _C2MATICA_CONFIGCACHE_H_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "main/Config.h"
+
+namespace c2matica {
+
+// Binary snapshot of the validated dpConfig rows, mmaped on start and used
+// instead of parsing when the hash of the dpConfig source matches.
+//
+// layout, native endian:
+//     header   magic[8] version count sourceHash poolSize checksum
+//     records  count * fixed size DataPointConfig without strings
+//     pool     strings referenced by (offset, length) from records
+//
+// The mapping only replaces reading and parsing the JSON source: records
+// are copied out and their strings assigned from the pool, rows own their
+// strings and the file is unmapped before returning. Rules are kept as
+// source and compiled again on every start, regex objects can not be
+// serialized; on reload unchanged rules come from the rule cache.
+// loadDPCOnfig logs the load time and whether the cache was used.
+bool loadConfigCache(
+    std::string const& file,
+    uint64_t sourceHash,
+    std::vector<Config::DataPointConfig>& out);
+
+bool saveConfigCache(
+    std::string const& file,
+    uint64_t sourceHash,
+    std::vector<Config::DataPointConfig> const& rows);
+
+}
+
+#endif
@@ -2,11 +2,20 @@
 #define _C2MATICA_COMMON_H_
 
 #include <string>
+#include <cstdint>
+#include <cstddef>
 
 namespace c2matica {
 
 std::string timeFormatNow();
 
+// 64 bits FNV-1a over 8 bytes words, stable across builds
+uint64_t hash64(void const* data, std::size_t size);
+
+// CPUs this process may use, the smaller of the sched_getaffinity mask and
+// the cgroup (v2 cpu.max or v1 cfs quota) CPU quota rounded up, at least 1
+int availableCpus();
+
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,51 @@
+#ifndef _C2MATICA_FILEWATCH_H_
+#define _C2MATICA_FILEWATCH_H_
+
+#include <string>
+#include <memory>
+#include <functional>
+
+#include "core/Timer.h"
+
+namespace c2matica {
+
+// Watch a file by inotify on its directory, so that editors which replace
+// the file by rename are catched too. Bursts of events are merged, the
+// callback runs once the file has been quiet for debounce milliseconds.
+class FileWatch
+{
+public:
+    static const uint32_t DEFAULT_DEBOUNCE = 200; // ms
+
+public:
+    FileWatch(const std::string& file, uint32_t debounce = DEFAULT_DEBOUNCE);
+    ~FileWatch();
+
+    // false if inotify is unavailable, caller should fall back to FileCheck
+    bool start(std::function<void()> onModified);
+    void stop();
+
+private:
+    const std::string _file;
+    std::string _dir;
+    std::string _name;
+    const uint32_t _debounce;
+
+    int _fd;
+    int _wd;
+    bool _pending;
+    Timer::steady_time _deadline;
+    std::function<void()> _onModified;
+
+    Timer _timer;
+
+    void poll();
+};
+
+std::unique_ptr<FileWatch> makeFileWatch(
+    const std::string& file,
+    uint32_t debounce = FileWatch::DEFAULT_DEBOUNCE);
+
+}
+
+#endif
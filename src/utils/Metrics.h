@@ -0,0 +1,51 @@
+#ifndef _C2MATICA_METRICS_H_
+#define _C2MATICA_METRICS_H_
+
+#include <array>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace c2matica {
+
+// Process wide registry of named counters and gauges, dumped as a flat
+// JSON object to a file that monitoring tools can read. Names are dotted,
+// e.g. datapoint.<dpId>.demoted
+class Metrics
+{
+public:
+    static Metrics& instance();
+
+    // gauge
+    void set(std::string const& name, double value);
+    // counter
+    void add(std::string const& name, double delta = 1);
+    // histogram of milliseconds, cumulative buckets <name>.le_<bound>
+    // plus <name>.count and <name>.sum, expanded to those names on write
+    void observe(std::string const& name, double ms);
+    // remove all metrics starting with prefix, e.g. a deleted datapoint
+    void erase(std::string const& prefix);
+
+    // write atomically by rename
+    bool writeTo(std::string const& file);
+
+private:
+    Metrics() = default;
+
+    static const std::size_t HISTOGRAM_BUCKETS = 11;
+
+    struct Histogram
+    {
+        std::array<double, HISTOGRAM_BUCKETS> buckets{};
+        double count = 0;   // also the le_inf bucket
+        double sum = 0;
+    };
+
+    std::mutex _mutex;
+    std::map<std::string, double> _values;
+    std::map<std::string, Histogram> _histograms;
+};
+
+}
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef _C2MATICA_TIMELINE_H_
+#define _C2MATICA_TIMELINE_H_
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace c2matica {
+
+// Record named marks from a start point and log where the time goes,
+// e.g. the startup of the process.
+class Timeline
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+public:
+    Timeline(std::string name);
+    ~Timeline() = default;
+
+    void mark(std::string const& what);
+    void log();
+
+private:
+    const std::string _name;
+    std::mutex _mutex;
+    Clock::time_point _start;
+    std::vector<std::pair<std::string, Clock::time_point>> _marks;
+};
+
+}
+
+#endif
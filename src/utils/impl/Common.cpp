@@ -1,5 +1,13 @@
 
+#ifdef __linux__
+#include <sched.h>
+#endif
+
 #include <ctime>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <thread>
 
 #include "utils/Common.h"
 
@@ -13,4 +21,75 @@ std::string timeFormatNow()
     return std::string(buf);
 }
 
-}
\ No newline at end of file
+uint64_t hash64(void const* data, std::size_t size)
+{
+    static const uint64_t FNV_OFFSET = 0xcbf29ce484222325ULL;
+    static const uint64_t FNV_PRIME = 0x100000001b3ULL;
+
+    auto p = static_cast<unsigned char const*>(data);
+    uint64_t h = FNV_OFFSET ^ size;
+    for (; size >= 8; size -= 8, p += 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, p, 8);
+        h = (h ^ word) * FNV_PRIME;
+        h ^= h >> 29;
+    }
+    for (; size > 0; size--, p++)
+        h = (h ^ *p) * FNV_PRIME;
+    return h;
+}
+
+static int cgroupCpuQuota()
+{
+    // cgroup v2: "max 100000" or "200000 100000"
+    {
+        std::ifstream i("/sys/fs/cgroup/cpu.max");
+        std::string quota;
+        double period;
+        if (i >> quota >> period)
+        {
+            if (quota == "max" || period <= 0)
+                return 0;
+            return (int)std::ceil(std::stod(quota) / period);
+        }
+    }
+
+    // cgroup v1, quota is -1 when unlimited
+    {
+        std::ifstream q("/sys/fs/cgroup/cpu/cpu.cfs_quota_us");
+        std::ifstream p("/sys/fs/cgroup/cpu/cpu.cfs_period_us");
+        double quota;
+        double period;
+        if (q >> quota && p >> period && quota > 0 && period > 0)
+            return (int)std::ceil(quota / period);
+    }
+
+    return 0;
+}
+
+int availableCpus()
+{
+    int cpus = std::thread::hardware_concurrency();
+
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0)
+        cpus = CPU_COUNT(&set);
+#endif
+
+    try
+    {
+        int quota = cgroupCpuQuota();
+        if (quota > 0 && quota < cpus)
+            cpus = quota;
+    }
+    catch (std::exception&)
+    {
+    }
+
+    return cpus > 0 ? cpus : 1;
+}
+
+}
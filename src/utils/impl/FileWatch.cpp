@@ -0,0 +1,151 @@
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#include <cstring>
+#include <cerrno>
+
+#include "utils/FileWatch.h"
+#include "3rdparty/easyloggingpp/easylogging++.h"
+
+namespace c2matica {
+
+// upper bound of one poll, keep stop() responsive
+static const int MAX_POLL_TIMEOUT = 200; // ms
+
+FileWatch::FileWatch(const std::string& file, uint32_t debounce)
+    : _file(file)
+    , _debounce(debounce)
+    , _fd(-1)
+    , _wd(-1)
+    , _pending(false)
+{
+    auto pos = _file.find_last_of('/');
+    _dir = pos == std::string::npos ? "." : _file.substr(0, pos + 1);
+    _name = pos == std::string::npos ? _file : _file.substr(pos + 1);
+}
+
+FileWatch::~FileWatch()
+{
+    stop();
+}
+
+#ifdef __linux__
+
+bool FileWatch::start(std::function<void()> onModified)
+{
+    if (_fd >= 0)
+        return true;
+
+    _fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (_fd < 0)
+    {
+        LOG(WARNING) << "inotify init failed: " << strerror(errno);
+        return false;
+    }
+
+    _wd = inotify_add_watch(_fd, _dir.c_str(),
+        IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_MODIFY);
+    if (_wd < 0)
+    {
+        LOG(WARNING) << "inotify watch " << _dir << " failed: "
+            << strerror(errno);
+        close(_fd);
+        _fd = -1;
+        return false;
+    }
+
+    LOG(INFO) << "watching " << _file << " by inotify, debounce "
+        << _debounce << "ms";
+
+    _pending = false;
+    _onModified = onModified;
+    _timer.run(std::bind(&FileWatch::poll, this));
+    return true;
+}
+
+void FileWatch::stop()
+{
+    _timer.stop();
+    if (_fd >= 0)
+    {
+        close(_fd);
+        _fd = -1;
+        _wd = -1;
+    }
+}
+
+void FileWatch::poll()
+{
+    int timeout = MAX_POLL_TIMEOUT;
+    if (_pending)
+    {
+        auto remain = std::chrono::duration_cast<std::chrono::milliseconds>(
+            _deadline - Timer::steady_clock::now()).count();
+        timeout = remain <= 0 ? 0 : std::min<int>(remain, MAX_POLL_TIMEOUT);
+    }
+
+    struct pollfd pfd = { _fd, POLLIN, 0 };
+    int rc = ::poll(&pfd, 1, timeout);
+    if (rc > 0 && (pfd.revents & POLLIN))
+    {
+        alignas(struct inotify_event) char buf[4096];
+        ssize_t len;
+        while ((len = read(_fd, buf, sizeof(buf))) > 0)
+        {
+            for (char* p = buf; p < buf + len; )
+            {
+                auto event = reinterpret_cast<struct inotify_event*>(p);
+                if (event->len > 0 && _name == event->name)
+                {
+                    _pending = true;
+                    _deadline = Timer::steady_clock::now()
+                        + std::chrono::milliseconds(_debounce);
+                }
+                p += sizeof(struct inotify_event) + event->len;
+            }
+        }
+    }
+    else if (rc < 0 && errno != EINTR)
+    {
+        LOG(ERROR) << "inotify poll " << _file << " failed: "
+            << strerror(errno);
+    }
+
+    if (_pending && Timer::steady_clock::now() >= _deadline)
+    {
+        _pending = false;
+        _onModified();
+    }
+}
+
+#else
+
+bool FileWatch::start(std::function<void()> onModified)
+{
+    (void)onModified;
+    return false;
+}
+
+void FileWatch::stop()
+{
+}
+
+void FileWatch::poll()
+{
+}
+
+#endif
+
+// -----------------------------------------------------------------------
+
+std::unique_ptr<FileWatch> makeFileWatch(
+    const std::string& file,
+    uint32_t debounce)
+{
+    return std::make_unique<FileWatch>(file, debounce);
+}
+
+}
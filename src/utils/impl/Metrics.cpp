@@ -0,0 +1,114 @@
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <fstream>
+#include <iterator>
+
+#include "3rdparty/easyloggingpp/easylogging++.h"
+#include "3rdparty/nlohmann/json.hpp"
+#include "utils/Metrics.h"
+
+using json = nlohmann::json;
+
+namespace c2matica {
+
+// upper bounds of the histogram buckets, ms
+static const double HISTOGRAM_BOUNDS[] = {
+    5, 10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000 };
+static_assert(std::size(HISTOGRAM_BOUNDS) == 11,
+    "Metrics::HISTOGRAM_BUCKETS out of date");
+
+Metrics& Metrics::instance()
+{
+    static Metrics metrics;
+    return metrics;
+}
+
+void Metrics::set(std::string const& name, double value)
+{
+    std::lock_guard<std::mutex> l(_mutex);
+    _values[name] = value;
+}
+
+void Metrics::add(std::string const& name, double delta)
+{
+    std::lock_guard<std::mutex> l(_mutex);
+    _values[name] += delta;
+}
+
+void Metrics::observe(std::string const& name, double ms)
+{
+    std::lock_guard<std::mutex> l(_mutex);
+    // one lookup, the bucket names are only built by writeTo
+    auto iter = _histograms.find(name);
+    if (iter == _histograms.end())
+        iter = _histograms.emplace(name, Histogram()).first;
+    Histogram& histogram = iter->second;
+    for (std::size_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+    {
+        if (ms <= HISTOGRAM_BOUNDS[i])
+            histogram.buckets[i] += 1;
+    }
+    histogram.count += 1;
+    histogram.sum += ms;
+}
+
+void Metrics::erase(std::string const& prefix)
+{
+    std::lock_guard<std::mutex> l(_mutex);
+    auto iter = _values.lower_bound(prefix);
+    while (iter != _values.end() &&
+           iter->first.compare(0, prefix.size(), prefix) == 0)
+    {
+        iter = _values.erase(iter);
+    }
+    auto hIter = _histograms.lower_bound(prefix);
+    while (hIter != _histograms.end() &&
+           hIter->first.compare(0, prefix.size(), prefix) == 0)
+    {
+        hIter = _histograms.erase(hIter);
+    }
+}
+
+bool Metrics::writeTo(std::string const& file)
+{
+    json j = json::object();
+    {
+        std::lock_guard<std::mutex> l(_mutex);
+        for (auto const& [name, value] : _values)
+            j[name] = value;
+        for (auto const& [name, histogram] : _histograms)
+        {
+            // empty buckets too, so that the layout is stable
+            for (std::size_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+            {
+                j[name + ".le_" + std::to_string((int)HISTOGRAM_BOUNDS[i])] =
+                    histogram.buckets[i];
+            }
+            j[name + ".le_inf"] = histogram.count;
+            j[name + ".count"] = histogram.count;
+            j[name + ".sum"] = histogram.sum;
+        }
+    }
+
+    std::string tmpFile = file + ".tmp";
+    {
+        std::ofstream o(tmpFile, std::ios::trunc);
+        o << j.dump(2) << std::endl;
+        if (!o)
+        {
+            LOG(WARNING) << "write metrics " << tmpFile << " failed";
+            return false;
+        }
+    }
+
+    if (rename(tmpFile.c_str(), file.c_str()) != 0)
+    {
+        LOG(WARNING) << "rename metrics " << file << " failed: "
+            << strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+}
@@ -0,0 +1,39 @@
+#include <sstream>
+
+#include "utils/Timeline.h"
+#include "3rdparty/easyloggingpp/easylogging++.h"
+
+namespace c2matica {
+
+Timeline::Timeline(std::string name)
+    : _name(name)
+    , _start(Clock::now())
+{
+}
+
+void Timeline::mark(std::string const& what)
+{
+    std::lock_guard<std::mutex> l(_mutex);
+    _marks.emplace_back(what, Clock::now());
+}
+
+void Timeline::log()
+{
+    std::lock_guard<std::mutex> l(_mutex);
+    std::ostringstream os;
+    auto last = _start;
+    for (auto const& [what, tp] : _marks)
+    {
+        os << " " << what << " +"
+           << std::chrono::duration_cast<std::chrono::milliseconds>(
+                  tp - last).count()
+           << "ms";
+        last = tp;
+    }
+    LOG(INFO) << _name << " timeline:" << os.str() << ", total "
+        << std::chrono::duration_cast<std::chrono::milliseconds>(
+               last - _start).count()
+        << "ms";
+}
+
+}